@@ -2,17 +2,75 @@
 #define ARENA_H
 #include <stdlib.h>
 
+/*
+ * Bump allocator that grows by chaining blocks.
+ *
+ * The Arena header sits at the start of its first block. When a request does
+ * not fit in the current block, a new block of at least `block_size` bytes is
+ * chained on (or taken from the spares left by earlier rewinds), so capacity
+ * follows the workload instead of a size picked up front. Allocation only
+ * fails when malloc does, and every failure is counted.
+ *
+ * Temporaries are released with arena_mark / arena_rewind, which also works
+ * across block boundaries.
+ *
+ * Growing buffers go through arena_realloc: the last allocation in the current
+ * block grows in place, anything else moves and its old space goes onto a
+ * power-of-two size-class free list that later arena_realloc calls draw from.
+ * Rewinding empties the free lists, since freed space may lie past the mark.
+ */
+
+#define ARENA_DEFAULT_ALIGNMENT 16
+// Alignment of dynamic array storage, wide enough for aligned AVX-512 loads.
+#define ARENA_SIMD_ALIGNMENT 64
+
+// Free list i holds freed ranges of [2^i, 2^(i+1)) bytes; smaller ranges are dropped.
+#define ARENA_SIZE_CLASSES 48
+#define ARENA_MIN_FREE_CLASS 6
+
+typedef struct ArenaBlock ArenaBlock;
+typedef struct ArenaFreeRange ArenaFreeRange;
+
 typedef struct {
-    size_t size, offset;
+    size_t size, offset;   // current block: total bytes and bytes used, header included
+    char* base;            // start of the current block
+    ArenaBlock* blocks;    // blocks chained after the first one, newest first
+    ArenaBlock* spare;     // blocks released by arena_rewind, reused before new ones
+    size_t first_size;     // size of the block holding this header
+    size_t block_size;     // minimum size of chained blocks
+    size_t used;           // bytes handed out, alignment padding included
+    size_t high_water;     // peak of `used`
+    size_t failed_allocs;  // allocations that returned NULL
+    size_t free_bytes;     // bytes sitting in the free lists
+    ArenaFreeRange* free_lists[ARENA_SIZE_CLASSES];
 } Arena;
 
+typedef struct {
+    ArenaBlock* block;  // NULL for the first block
+    size_t offset;
+    size_t used;
+} ArenaMark;
+
 Arena* init_arena(size_t size);
 void free_arena(Arena* arena);
 void* _arena_alloc_impl(Arena* arena, size_t size);
 void* arena_alloc(Arena* arena, size_t size);
+// `alignment` must be a power of two.
+void* arena_alloc_aligned(Arena* arena, size_t size, size_t alignment);
+// Resizes `ptr` (old_size bytes, may be NULL) to new_size, keeping the contents.
+// On failure returns NULL and leaves `ptr` untouched.
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size, size_t alignment);
+// Hands a range back for reuse by arena_realloc.
+void arena_free(Arena* arena, void* ptr, size_t size);
 void _arena_dealloc_impl(Arena* arena, size_t size);
 void arena_dealloc(Arena* arena, size_t size);
 
+ArenaMark arena_mark(const Arena* arena);
+// Frees everything allocated since `mark`; blocks chained after it become spares.
+void arena_rewind(Arena* arena, ArenaMark mark);
+// Rewinds to empty, keeping chained blocks as spares.
+void arena_reset(Arena* arena);
+
 #define arena_push(arena, typename) ((typename*)_arena_alloc_impl(arena, sizeof(typename)))
 
 #define arena_pop(arena, typename) (_arena_dealloc_impl(arena, sizeof(typename)))
@@ -20,4 +78,4 @@ void arena_dealloc(Arena* arena, size_t size);
 Arena* init_scratch_arena(Arena* base_arena, size_t size);
 void free_scratch_arena(Arena* base_arena, Arena* scratch_arena);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,50 @@
+#ifndef BARNES_HUT_H
+#define BARNES_HUT_H
+
+#include "arena.h"
+#include "dynamic_array.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Barnes-Hut quadtree used as an O(N log N) alternative to the direct pair sum.
+ *
+ * The tree is rebuilt from scratch every time forces are evaluated, so all of
+ * its storage comes out of a caller-provided arena and is released by rewinding
+ * the arena to a mark afterwards.
+ */
+
+#define QUADTREE_MAX_DEPTH 48
+#define QUADTREE_NO_NODE (-1)
+
+typedef struct {
+    double center_x, center_y;  // geometric center of the cell
+    double half_size;           // half of the cell edge length
+    double com_x, com_y;        // center of mass of everything below this node
+    double mass;
+    int32_t children[4];        // QUADTREE_NO_NODE when the quadrant is empty
+    int32_t first_body;         // leaves only: head of the body list, -1 otherwise
+    bool is_leaf;
+} QuadNode;
+
+DEFINE_ARRAY(QuadNode);
+
+typedef struct {
+    Array_QuadNode nodes;
+    int32_t* next_body;  // per-body link for leaves that hold more than one body
+    const double* x;     // source arrays the tree was built from, not owned
+    const double* y;
+    const double* mass;
+    size_t body_count;
+} QuadTree;
+
+bool quadtree_build(QuadTree* tree, const double* x, const double* y, const double* mass,
+                    size_t count, Arena* arena);
+
+// Returns sum(m_j * d / |d|^3) at (px, py), skipping source `exclude` (pass -1 for none).
+// The caller scales the result by G.
+void quadtree_field(const QuadTree* tree, double px, double py, int32_t exclude,
+                    double theta, double* out_x, double* out_y);
+
+#endif
@@ -2,6 +2,7 @@
 #define DYNAMIC_ARRAY_H
 
 #include "arena.h"
+#include <stdbool.h>
 #include <string.h>
 
 /*
@@ -10,14 +11,13 @@
  * Usage example:
  *   DEFINE_ARRAY(int);  // Define Array_int type
  *   
- *   Arena arena = {0};
- *   arena_init(&arena, 1024);
+ *   Arena* arena = init_arena(1024);
  *   
  *   Array_int arr = {0};
- *   array_init(&arr, 4, &arena);
+ *   array_init(&arr, 4, arena);
  *   
- *   array_push(&arr, 42, &arena);
- *   array_push(&arr, 100, &arena);
+ *   array_push(&arr, 42, arena);
+ *   array_push(&arr, 100, arena);
  *   
  *   int val = array_get(&arr, 0);  // val = 42
  *   array_set(&arr, 1, 200);       // arr[1] = 200
@@ -35,31 +35,74 @@
         size_t capacity; \
     } Array_##T
 
+// Returned by array_push when the arena could not supply more room; the array is left unchanged.
+#define ARRAY_NO_INDEX ((size_t)-1)
+
 // Initialize an array with initial capacity
 #define array_init(arr, cap, arena) \
     do { \
-        (arr)->capacity = (cap); \
         (arr)->length = 0; \
-        (arr)->data = arena_alloc((arena), (cap) * sizeof(*(arr)->data)); \
+        (arr)->data = arena_alloc_aligned((arena), (cap) * sizeof(*(arr)->data), ARENA_SIMD_ALIGNMENT); \
+        (arr)->capacity = (arr)->data ? (cap) : 0; \
     } while(0)
 
-// Push an element to the array (grows if needed) - returns the index of the new element
-#define array_push(arr, value, arena) \
+// Grow capacity to at least min_cap, keeping the contents - returns false if the arena is out of memory.
+// Growth goes through arena_realloc, so it happens in place when the array is the arena's last allocation.
+#define array_reserve(arr, min_cap, arena) \
     ({ \
-        if ((arr)->length >= (arr)->capacity) { \
-            size_t new_cap = (arr)->capacity == 0 ? 8 : (arr)->capacity * 2; \
-            typeof((arr)->data) new_data = arena_alloc((arena), new_cap * sizeof(*(arr)->data)); \
-            if ((arr)->data) { \
-                memcpy(new_data, (arr)->data, (arr)->length * sizeof(*(arr)->data)); \
+        size_t _min_cap = (min_cap); \
+        bool _ok = true; \
+        if (_min_cap > (arr)->capacity) { \
+            typeof((arr)->data) new_data = arena_realloc((arena), (arr)->data, \
+                                                         (arr)->capacity * sizeof(*(arr)->data), \
+                                                         _min_cap * sizeof(*(arr)->data), ARENA_SIMD_ALIGNMENT); \
+            if (new_data) { \
+                (arr)->data = new_data; \
+                (arr)->capacity = _min_cap; \
+            } else { \
+                _ok = false; \
             } \
-            (arr)->data = new_data; \
-            (arr)->capacity = new_cap; \
         } \
-        size_t _index = (arr)->length; \
-        (arr)->data[(arr)->length++] = (value); \
+        _ok; \
+    })
+
+// Make room for `count` more elements, doubling so repeated pushes stay amortized O(1)
+#define array_grow_for(arr, count, arena) \
+    ({ \
+        size_t _need = (arr)->length + (count); \
+        size_t _cap = (arr)->capacity == 0 ? 8 : (arr)->capacity; \
+        while (_cap < _need) _cap *= 2; \
+        _need <= (arr)->capacity || array_reserve((arr), _cap, (arena)); \
+    })
+
+// Push an element to the array (grows if needed) - returns the index of the new element,
+// or ARRAY_NO_INDEX if growing failed
+#define array_push(arr, value, arena) \
+    ({ \
+        size_t _index = ARRAY_NO_INDEX; \
+        if (array_grow_for((arr), 1, (arena))) { \
+            _index = (arr)->length; \
+            (arr)->data[(arr)->length++] = (value); \
+        } \
         _index; \
     })
 
+// Append `count` elements copied from `values` - returns the index of the first one,
+// or ARRAY_NO_INDEX (array unchanged) if growing failed
+#define array_push_n(arr, values, count, arena) \
+    ({ \
+        size_t _count = (count); \
+        size_t _first = ARRAY_NO_INDEX; \
+        if (array_grow_for((arr), _count, (arena))) { \
+            _first = (arr)->length; \
+            if (_count > 0) { \
+                memcpy((arr)->data + _first, (values), _count * sizeof(*(arr)->data)); \
+            } \
+            (arr)->length += _count; \
+        } \
+        _first; \
+    })
+
 // Get element at index
 #define array_get(arr, index) ((arr)->data[index])
 
@@ -0,0 +1,83 @@
+#ifndef GRAVITY_H
+#define GRAVITY_H
+
+#include "arena.h"
+#include "worker_pool.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Direct-sum gravity kernels.
+ *
+ * All functions here return the unscaled field sum(m_j * d / |d|^3); the caller
+ * multiplies by G. Sources at exactly the target position (including the target
+ * itself) contribute nothing.
+ *
+ * The SIMD kernels evaluate every target against every source in ascending
+ * source order, 4 (AVX2) or 8 (AVX-512) double-precision pairs per instruction.
+ * Instead of sqrt and divide they refine the hardware 1/sqrt estimate with
+ * Newton steps to within a few ulp, and they sum in a different order than the
+ * scalar pairwise path, so per component
+ *
+ *     |a_simd - a_scalar| <= GRAVITY_SIMD_TOLERANCE * sum_j |m_j / r_ij^2|
+ *
+ * which is the usual reordering bound (N * eps) for up to ~10k bodies. Observed
+ * differences at 10k random bodies are around 1e-14.
+ */
+
+#define GRAVITY_SIMD_TOLERANCE 1e-12
+
+// Tile shape for gravity_field_tiled: targets per task and sources per block.
+#define GRAVITY_TILE_TARGETS 64
+#define GRAVITY_TILE_SOURCES 2048
+
+// Split of the i<j triangle for gravity_field_pairwise_tiled: at most this
+// many tiles, each of at least GRAVITY_PAIR_TILE_MIN_PAIRS pairs, with all
+// their buffers together within GRAVITY_PAIR_SCRATCH_BYTES.
+#define GRAVITY_PAIR_TILES 64
+#define GRAVITY_PAIR_TILE_MIN_PAIRS (1 << 16)
+#define GRAVITY_PAIR_SCRATCH_BYTES (32 * 1024 * 1024)
+
+typedef enum {
+    GRAVITY_KERNEL_SCALAR,
+    GRAVITY_KERNEL_AVX2,
+    GRAVITY_KERNEL_AVX512,
+} GravityKernel;
+
+// Kernel in use. The first call picks the widest one the CPU supports.
+GravityKernel gravity_kernel(void);
+// Forces a kernel; returns false and keeps the current one if the CPU lacks it.
+bool gravity_set_kernel(GravityKernel kernel);
+bool gravity_kernel_supported(GravityKernel kernel);
+const char* gravity_kernel_name(GravityKernel kernel);
+
+// Symmetric i<j pair loop over `count` bodies, single-threaded; the scalar reference.
+void gravity_field_pairwise(const double* x, const double* y, const double* mass, size_t count,
+                            double* out_x, double* out_y);
+
+// The same pair loop, doing half the pair work of the tiled kernels, split
+// into row ranges of the i<j triangle with about equal pair counts and run
+// on `pool`. Each tile sums into its own buffer from `scratch` (rewound
+// before returning) and the buffers are added up in tile order. The tile
+// count depends on `count` alone, so the result is bitwise identical for any
+// thread count, and with one tile it equals gravity_field_pairwise. The
+// direct solver uses it for the body-body sum under the scalar kernel.
+void gravity_field_pairwise_tiled(WorkerPool* pool, const double* x, const double* y, const double* mass,
+                                  size_t count, double* out_x, double* out_y, Arena* scratch);
+
+// Field at targets [begin, end) of (tx, ty) from all `count` sources, using the active kernel.
+void gravity_field_rows(const double* x, const double* y, const double* mass, size_t count,
+                        const double* tx, const double* ty, size_t begin, size_t end,
+                        double* out_x, double* out_y);
+
+// Field at all `target_count` targets, split into tiles of GRAVITY_TILE_TARGETS
+// targets by GRAVITY_TILE_SOURCES sources and run on `pool` (NULL runs inline).
+// Each task sums its source blocks into a private buffer in ascending order, so
+// the result is bitwise identical for any thread count.
+void gravity_field_tiled(WorkerPool* pool,
+                         const double* x, const double* y, const double* mass, size_t count,
+                         const double* tx, const double* ty, size_t target_count,
+                         double* out_x, double* out_y);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef KEPLER_H
+#define KEPLER_H
+
+#include <stdbool.h>
+
+/*
+ * Analytic two-body propagation.
+ *
+ * Advances a relative state (x, y, vx, vy) around a point mass with
+ * gravitational parameter mu = G * M by dt seconds using universal variables,
+ * so elliptic, parabolic and hyperbolic orbits share one code path. Returns
+ * false and leaves the state untouched if the solver does not converge.
+ */
+
+bool kepler_drift(double mu, double dt, double* x, double* y, double* vx, double* vy);
+
+#endif
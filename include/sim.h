@@ -3,51 +3,242 @@
 
 #include "arena.h"
 #include "dynamic_array.h"
-#include "raylib.h"
+#include "worker_pool.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// 8-bit RGBA. Same layout as raylib's Color, so the renderer converts by value and
+// the simulation itself does not depend on raylib.
+typedef struct {
+    unsigned char r, g, b, a;
+} SimColor;
+
+// Value type used to pass a whole body in and out of the simulation.
 typedef struct {
     double x, y;
     double vx, vy;
     double mass;
     float radius;
-    Color color;
+    SimColor color;
     const char* name;
 } PhysicalBody;
 
-DEFINE_ARRAY(PhysicalBody);
+// Render-only data, kept out of the arrays the integrator streams through.
+typedef struct {
+    float radius;
+    SimColor color;
+    const char* name;
+} BodyMeta;
+
+DEFINE_ARRAY(double);
+DEFINE_ARRAY(BodyMeta);
+
+// Structure-of-arrays body storage. All arrays share the same length and are
+// indexed densely; removal swaps the last body into the hole.
+typedef struct {
+    Array_double x, y;
+    Array_double vx, vy;
+    Array_double mass;
+    Array_BodyMeta meta;
+} BodyStore;
+
+// Stable body handle: slot index in the low 32 bits, the slot's generation
+// above. Removing a body bumps the generation, so old handles stop resolving
+// instead of pointing at whichever body reuses the slot.
+typedef int64_t BodyId;
+
+#define SIM_NO_BODY ((BodyId)-1)
+
+typedef struct {
+    uint32_t dense;       // index into BodyStore while live, next free slot otherwise
+    uint32_t generation;
+    bool live;
+} BodySlot;
+
+DEFINE_ARRAY(BodySlot);
+DEFINE_ARRAY(uint32_t);
 
 typedef struct {
     double x, y;
 } TrailPoint;
 
+// Trails are stored in chunks of SIM_TRAIL_CHUNK_POINTS points: one double
+// anchor plus float offsets from it, about 8 bytes a point instead of 16.
+// Floats keep 24 bits of the chunk's extent, well under a pixel whenever the
+// chunk spans less than a few million pixels on screen.
+#define SIM_TRAIL_CHUNK_POINTS 64
+
+// A chunk is re-anchored when the ring comes back round to its first lane,
+// and its older points are retired with it, so a full trail holds between
+// capacity - SIM_TRAIL_CHUNK_POINTS + 1 and capacity points.
+typedef struct {
+    float dx[SIM_TRAIL_CHUNK_POINTS];
+    float dy[SIM_TRAIL_CHUNK_POINTS];
+    double anchor_x, anchor_y;  // the chunk's first point
+    float min_dx, min_dy, max_dx, max_dy;  // bounds of the offsets written since the anchor
+} TrailChunk;
+
 typedef struct {
-    TrailPoint* points;
-    size_t capacity;
-    size_t head;
+    TrailChunk* chunks;
+    size_t capacity;  // points, a multiple of SIM_TRAIL_CHUNK_POINTS
+    size_t head;      // ring index of the next point written
     size_t count;
+    double last_x, last_y;  // the newest point at full precision
+    double heading;  // direction of the newest segment, radians
+    double turn;     // heading change summed along the path since the second-newest point
 } TrailBuffer;
 
 DEFINE_ARRAY(TrailBuffer);
 
+DEFINE_ARRAY(SimColor);
+
+typedef Arena* ArenaPtr;
+DEFINE_ARRAY(ArenaPtr);
+
+// Test particles feel gravity from the bodies above but exert none, so they cost
+// O(bodies) each instead of joining the pair sum. They have no trails or labels.
+typedef struct {
+    Array_double x, y;
+    Array_double vx, vy;
+    Array_SimColor color;
+} ParticleStore;
+
+// Accelerations of all bodies followed by all test particles.
+typedef struct {
+    Array_double ax, ay;
+} AccelBuffer;
+
+// Positions of all bodies followed by all test particles.
 typedef struct {
-    Arena* sim_arena;
-    Array_PhysicalBody bodies;
-    Array_TrailBuffer trails;
+    Array_double x, y;
+    bool valid;  // cleared by anything that adds, removes or edits bodies or particles
+} PositionBuffer;
+
+typedef enum {
+    SIM_SOLVER_DIRECT,      // O(N^2) pair sum, the reference mode
+    SIM_SOLVER_BARNES_HUT,  // quadtree approximation, see barnes_hut.h
+} SimSolver;
+
+#define SIM_DEFAULT_BH_THETA 0.5
+#define SIM_DEFAULT_TRAIL_INTERVAL 1800.0
+#define SIM_DEFAULT_TRAIL_TOLERANCE 0.005
+
+typedef enum {
+    SIM_INTEGRATOR_VERLET,         // velocity Verlet on barycentric coordinates
+    SIM_INTEGRATOR_WISDOM_HOLMAN,  // symplectic Kepler-drift map around the most massive body
+} SimIntegrator;
+
+// Initial sizes of the transient arenas; both chain more blocks when needed.
+#define SIM_FRAME_ARENA_SIZE (1024 * 1024)
+#define SIM_WORKER_ARENA_SIZE (256 * 1024)
+
+typedef struct {
+    Arena* sim_arena;  // long-lived data only: stores, trails, acceleration buffers
+
+    // Transient memory in arenas of its own, made on first use, so runs that
+    // never draw or step carry none of it and sim_arena's byte counts measure
+    // the scenario alone. The two frame arenas alternate at sim_begin_frame,
+    // which makes them, so data built during one frame stays valid through the
+    // next. Worker arena i belongs to pool worker i (0 is the calling thread,
+    // which sim_step uses) and holds temporaries that are rewound before the
+    // call that made them returns; without a pool there is only worker 0's.
+    Arena* frame_arenas[2];
+    int frame_index;
+    Array_ArenaPtr worker_arenas;
+
+    BodyStore bodies;
+    ParticleStore particles;
+    Array_BodySlot body_slots;
+    Array_uint32_t body_slot_of;  // dense index -> slot, parallel to the store arrays
+    uint32_t free_slot;           // head of the free slot list, UINT32_MAX when empty
+    Array_TrailBuffer trails;     // parallel to the store arrays
+    size_t trail_slots;  // trails.data[0, trail_slots) own buffers, including ones past length after a reset
     double time_seconds;
-    int trail_frame_counter;
-} SimContext;
+    double trail_interval;     // sim seconds between trail samples; 0 stops recording
+    double trail_next_sample;  // sim time of the next sample
+    // Largest trail deviation from the drawn segment, as a fraction of the
+    // segment's length; samples within it are merged. 0 keeps every sample.
+    double trail_tolerance;
+    size_t trail_length;  // points per trail for bodies added from now on, rounded up to whole chunks; 0 disables trails
+    SimSolver solver;
+    double bh_theta;  // Barnes-Hut opening angle; smaller is more accurate
+    SimIntegrator integrator;
+    int thread_count;  // set through sim_set_thread_count
+    WorkerPool* pool;  // NULL when running single-threaded
+
+    // Accelerations at the current state, left over from the previous step's
+    // second force evaluation. Anything that edits the store arrays directly
+    // must call sim_invalidate_accelerations.
+    AccelBuffer accel;
+    AccelBuffer accel_next;
+    bool accel_valid;
+    SimSolver accel_solver;
+    double accel_theta;
 
-typedef long BodyId;
+    // Positions as they were before the latest step, saved by
+    // sim_keep_previous_positions so frames can be drawn between two states.
+    PositionBuffer previous;
+
+    unsigned long force_evaluations;  // full force passes since sim_init, for benchmarks
+} SimContext;
 
+// sim_init seeds the solar system; sim_init_empty leaves the store empty for
+// callers that seed their own scenario.
 void sim_init(SimContext* sim, Arena* arena);
+void sim_init_empty(SimContext* sim, Arena* arena);
 void sim_reset(SimContext* sim);
+void sim_shutdown(SimContext* sim);
+void sim_set_thread_count(SimContext* sim, int thread_count);
+// Call once per rendered frame: switches to the other frame arena, making it
+// the first time and emptying it after that, and empties the worker arenas.
+void sim_begin_frame(SimContext* sim);
+// NULL before the first sim_begin_frame or if the frame arena could not be made. Render code never falls back to
+// sim_arena: rewinding it would drop the free lists that trails and arrays reuse.
+Arena* sim_frame_arena(const SimContext* sim);
+Arena* sim_worker_arena(const SimContext* sim, int worker_index);
+// Also drops sim->previous.
+void sim_invalidate_accelerations(SimContext* sim);
+// Copies the current positions into sim->previous; call right before the
+// sim_step to interpolate across. Returns false if the arena ran out.
+bool sim_keep_previous_positions(SimContext* sim);
+// Sizes the stores for at least this many bodies and particles in one go, so
+// loaders adding many of either do not regrow the arrays along the way.
+bool sim_reserve(SimContext* sim, size_t body_count, size_t particle_count);
+// Returns SIM_NO_BODY if the arena is out of memory.
 BodyId sim_add_body(SimContext* sim, PhysicalBody body);
+// Swap-removes the body; its handle and any copies of it stop resolving.
+bool sim_remove_body(SimContext* sim, BodyId id);
+size_t sim_body_count(const SimContext* sim);
+// Dense index of a live body, or -1 for a removed or invalid handle.
+long sim_body_index(const SimContext* sim, BodyId id);
+// Handle of the body currently at dense index `index`.
+BodyId sim_body_id(const SimContext* sim, size_t index);
+PhysicalBody sim_get_body(const SimContext* sim, BodyId id);
+// The i-th point of `trail`, oldest first.
+TrailPoint sim_trail_point(const TrailBuffer* trail, size_t i);
+void sim_set_body(SimContext* sim, BodyId id, PhysicalBody body);
+size_t sim_particle_count(const SimContext* sim);
+// Returns ARRAY_NO_INDEX if the arena is out of memory. The ring helpers return how many they added.
+size_t sim_add_test_particle(SimContext* sim, double x, double y, double vx, double vy, SimColor color);
+size_t sim_add_particle_ring(SimContext* sim, BodyId parent_id, double inner_radius, double outer_radius,
+                             size_t count, SimColor color, unsigned long rng_seed);
+// Like sim_add_particle_ring, but adds massive bodies that take part in the pair sum.
+size_t sim_add_body_ring(SimContext* sim, BodyId parent_id, double inner_radius, double outer_radius,
+                         size_t count, double mass, SimColor color, unsigned long rng_seed);
+// Evaluates the accelerations of every body and particle at the current state
+// into sim->accel, where the next Verlet step picks them up. Returns false if
+// the buffers could not be allocated.
+bool sim_compute_accelerations(SimContext* sim);
 void sim_step(SimContext* sim, double dt_seconds);
-void sim_draw(const SimContext* sim, double cam_x, double cam_y, double zoom, int screen_w, int screen_h);
 BodyId sim_add_body_circular_orbit(SimContext* sim, BodyId parent_id,
                                    double orbit_radius, double initial_angle,
-                                   double mass, float radius, Color color, const char* name);
+                                   double mass, float radius, SimColor color, const char* name);
 BodyId sim_add_body_elliptical_orbit(SimContext* sim, BodyId parent_id,
                                      double periapsis, double apoapsis, double initial_angle,
-                                     double mass, float radius, Color color, const char* name);
+                                     double mass, float radius, SimColor color, const char* name);
+void sim_seed_solar_system(SimContext* sim);
+// `count` bodies scattered uniformly over a disk of `radius` meters around the
+// origin, on roughly circular orbits about the disk's own mass.
+void sim_seed_random_disk(SimContext* sim, size_t count, double radius, unsigned long rng_seed);
 #endif
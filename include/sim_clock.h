@@ -0,0 +1,42 @@
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include "sim.h"
+
+#include <stdbool.h>
+
+/*
+ * Fixed-timestep driver for sim_step.
+ *
+ * Each frame adds its share of sim time to an accumulator, which is then
+ * consumed in whole steps of fixed_dt, so the physics never depends on the
+ * frame rate or on frame hitches. Stepping stops once the frame's wall-clock
+ * budget is spent; whatever is left carries over, and backlog beyond one
+ * frame's worth is dropped and reported instead of snowballing.
+ *
+ * The positions before the frame's last step are kept in sim->previous, so
+ * the frame can be drawn at the time the accumulator has reached: one step
+ * behind, blended sim_clock_blend of the way back from the current state.
+ * Physics then runs at its own rate, below the frame rate if need be,
+ * without moving in visible jumps.
+ */
+
+typedef struct {
+    double fixed_dt;          // sim seconds per step
+    double budget_seconds;    // wall-clock time allowed per sim_clock_advance call
+    double accumulator;       // sim seconds not simulated yet, always < fixed_dt unless behind
+    int steps_last_frame;
+    double dropped_seconds;   // total sim time discarded to keep up with real time
+    bool behind;              // the last frame ran out of budget with whole steps left
+} SimClock;
+
+void sim_clock_init(SimClock* clock, double fixed_dt, double budget_seconds);
+// Returns the sim time actually advanced.
+double sim_clock_advance(SimClock* clock, SimContext* sim, double sim_dt);
+// How far back from the current positions towards sim->previous to draw,
+// 0 to 1; for SimView.blend. 0 when the clock is behind.
+double sim_clock_blend(const SimClock* clock);
+// Monotonic wall clock in seconds.
+double sim_clock_now(void);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SIM_DRAW_H
+#define SIM_DRAW_H
+
+#include "sim.h"
+#include "sim_render.h"
+#include "raylib.h"
+
+// raylib renderer for a SimContext. Lives outside the simulation library so
+// headless builds never link against raylib. `text` should measure with
+// sim_draw_measure_text and be kept across frames. `blend` is SimView.blend.
+void sim_draw(const SimContext* sim, SimTextCache* text, double cam_x, double cam_y, double zoom, int screen_w,
+              int screen_h, double blend);
+// SimTextMeasure backed by raylib's default font.
+int sim_draw_measure_text(const char* text, int font_size, void* user);
+// Submits a list built by sim_render_build.
+void sim_draw_list(const SimRenderList* list);
+
+// Texture the density image is uploaded into, recreated when the window
+// size changes. Zero-initialise, and unload before closing the window.
+typedef struct {
+    Texture2D texture;
+    bool loaded;
+} SimSplatTexture;
+
+// Density-mode counterpart of sim_draw: splats every body and particle and
+// draws the tone-mapped result as one full-screen texture.
+void sim_draw_splat(const SimContext* sim, SimSplatTexture* target, double cam_x, double cam_y, double zoom,
+                    int screen_w, int screen_h, double blend);
+void sim_splat_texture_unload(SimSplatTexture* target);
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef SIM_RENDER_H
+#define SIM_RENDER_H
+
+#include "sim.h"
+
+/*
+ * Screen-space geometry for a SimContext.
+ *
+ * Drawing is split in two. sim_render_build transforms, culls and places
+ * labels, writing flat per-primitive command arrays into a transient arena;
+ * it needs no graphics library, so it runs (and can be checked and timed)
+ * headless. A backend such as sim_draw.c then only submits the arrays, one
+ * batch per primitive kind, in SimRenderList field order.
+ */
+
+typedef struct {
+    double cam_x, cam_y;  // world position at the centre of the screen
+    double zoom;          // pixels per metre
+    int screen_w, screen_h;
+    // Fraction of the way back from the current positions towards
+    // sim->previous to draw bodies and particles at, see sim_clock_blend.
+    // 0 draws the current state; ignored while sim->previous is not valid.
+    double blend;
+} SimView;
+
+typedef struct {
+    float x, y;  // screen pixels
+    SimColor color;
+} SimVertex;
+
+typedef struct {
+    float x, y, size;  // top-left corner and side, pixels
+    SimColor color;
+} SimQuad;
+
+typedef struct {
+    float x, y, radius;
+    SimColor color;
+} SimCircle;
+
+typedef struct {
+    int x, y;  // top-left corner
+    int font_size;
+    SimColor color;
+    const char* text;  // borrowed from the SimContext
+} SimLabel;
+
+DEFINE_ARRAY(SimVertex);
+DEFINE_ARRAY(SimQuad);
+DEFINE_ARRAY(SimCircle);
+DEFINE_ARRAY(SimLabel);
+
+typedef struct {
+    Array_SimVertex lines;    // trails, two vertices per segment
+    Array_SimQuad quads;      // test particles, then bodies drawn at the minimum size
+    Array_SimCircle circles;  // bodies larger than that
+    Array_SimLabel labels;    // body names that fit without overlapping
+} SimRenderList;
+
+// Width in pixels of `text` drawn at `font_size`.
+typedef int (*SimTextMeasure)(const char* text, int font_size, void* user);
+
+typedef struct {
+    const char* text;  // NULL for an empty entry
+    int font_size;
+    int width;
+} SimTextWidth;
+
+// Text widths remembered across frames, keyed by string address: body names
+// are borrowed pointers that outlive their bodies, so the address identifies
+// the text. Call sim_text_cache_clear if a string is ever rewritten in place.
+typedef struct {
+    SimTextWidth* entries;  // open addressing, capacity a power of two
+    size_t capacity;
+    size_t count;
+    SimTextMeasure measure;
+    void* measure_user;
+    Arena* arena;  // persistent: the table lives as long as the cache
+} SimTextCache;
+
+void sim_text_cache_init(SimTextCache* cache, SimTextMeasure measure, void* measure_user, Arena* arena);
+void sim_text_cache_clear(SimTextCache* cache);
+// Measures on the first request only. Falls back to measuring every time if
+// the table cannot grow.
+int sim_text_width(SimTextCache* cache, const char* text, int font_size);
+
+// Builds the commands for one frame into `list`, allocating from `arena`
+// (normally sim_frame_arena). Returns false if the arena ran out, leaving
+// whatever was built so far.
+bool sim_render_build(const SimContext* sim, const SimView* view, SimTextCache* text, Arena* arena,
+                      SimRenderList* list);
+
+// Density mode for scenes with too many objects to draw one by one: every
+// body and particle is counted into the screen pixel it falls in, and the
+// counts are tone-mapped into an image drawn once.
+typedef struct {
+    int width, height;
+    uint32_t* counts;  // width * height, row-major
+    uint32_t max_count;
+} SimSplat;
+
+// Counts in parallel on sim's worker pool: points are first binned by row
+// band, then each band is counted into its own rows of `splat`, so no thread
+// needs a grid of its own. Everything comes from `arena`: the grid plus one
+// index per point on screen. Integer sums, so the result does not depend on
+// the thread count. Returns false if the arena ran out.
+bool sim_splat_build(const SimContext* sim, const SimView* view, Arena* arena, SimSplat* splat);
+// Writes width * height pixels: log-scaled counts along a dark-red to white
+// ramp, transparent where nothing landed. Runs on sim's worker pool.
+void sim_splat_tonemap(const SimContext* sim, const SimSplat* splat, SimColor* pixels);
+
+// Writes the visible part of the trail into `out` as a line list, two
+// vertices per segment, oldest first; `out` needs room for
+// 2 * (trail->count - 1). Chunks off screen are skipped whole and runs of
+// points under a pixel apart become one segment. Alpha ramps from 20 at the
+// oldest point towards 200 at the newest. Returns the vertex count.
+size_t sim_trail_vertices(const TrailBuffer* trail, SimColor color, const SimView* view, SimVertex* out);
+
+#endif
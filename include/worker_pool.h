@@ -0,0 +1,28 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+
+/*
+ * Fixed-size pool of persistent threads for data-parallel loops.
+ *
+ * worker_pool_run hands out task indices [0, task_count) to the workers and the
+ * calling thread (worker 0) and returns once every task has finished. Which
+ * worker runs which task is not deterministic, so tasks must write disjoint
+ * outputs for results to be independent of the thread count.
+ */
+
+typedef struct WorkerPool WorkerPool;
+
+typedef void (*WorkerTaskFn)(void* ctx, size_t task_index, int worker_index);
+
+// thread_count includes the calling thread; returns NULL on failure.
+WorkerPool* worker_pool_create(int thread_count);
+void worker_pool_destroy(WorkerPool* pool);
+int worker_pool_thread_count(const WorkerPool* pool);
+int worker_pool_cpu_count(void);
+
+// A NULL pool runs every task inline on the calling thread.
+void worker_pool_run(WorkerPool* pool, size_t task_count, WorkerTaskFn fn, void* ctx);
+
+#endif
@@ -1,50 +1,268 @@
 #include "arena.h"
 
+#include <stdint.h>
+#include <string.h>
+
+struct ArenaBlock {
+    ArenaBlock* prev;
+    size_t size;  // total bytes, header included
+};
+
+// Lives in the freed range itself.
+struct ArenaFreeRange {
+    ArenaFreeRange* next;
+    size_t size;
+};
+
+static void arena_setup(Arena* arena, size_t total_size) {
+    *arena = (Arena){
+        .size = total_size,
+        .offset = sizeof(Arena),
+        .base = (char*)arena,
+        .first_size = total_size,
+        .block_size = total_size,
+    };
+}
+
 Arena* init_arena(size_t size) {
     Arena* arena = (Arena*)malloc(size + sizeof(Arena));
     if (!arena) {
         return NULL;
     }
-    arena->size = size + sizeof(Arena);
-    arena->offset = sizeof(Arena);
+    arena_setup(arena, size + sizeof(Arena));
     return arena;
 }
 
+static void free_block_list(ArenaBlock* block) {
+    while (block) {
+        ArenaBlock* prev = block->prev;
+        free(block);
+        block = prev;
+    }
+}
+
 void free_arena(Arena* arena) {
+    if (!arena) {
+        return;
+    }
+    free_block_list(arena->blocks);
+    free_block_list(arena->spare);
     free(arena);
 }
 
-void* _arena_alloc_impl(Arena* arena, size_t size) {
-    if (!arena || arena->offset + size > arena->size) {
+// Makes a block with room for `needed` bytes after its header the current one.
+static int arena_grow(Arena* arena, size_t needed) {
+    const size_t total = sizeof(ArenaBlock) + needed;
+    if (total < needed) {
+        return 0;
+    }
+
+    ArenaBlock** link = &arena->spare;
+    ArenaBlock* block = NULL;
+    while (*link) {
+        if ((*link)->size >= total) {
+            block = *link;
+            *link = block->prev;
+            break;
+        }
+        link = &(*link)->prev;
+    }
+
+    if (!block) {
+        const size_t size = total > arena->block_size ? total : arena->block_size;
+        block = (ArenaBlock*)malloc(size);
+        if (!block) {
+            return 0;
+        }
+        block->size = size;
+    }
+
+    block->prev = arena->blocks;
+    arena->blocks = block;
+    arena->base = (char*)block;
+    arena->size = block->size;
+    arena->offset = sizeof(ArenaBlock);
+    return 1;
+}
+
+void* arena_alloc_aligned(Arena* arena, size_t size, size_t alignment) {
+    if (!arena) {
         return NULL;
     }
-    void* ptr = (char*)(arena) + arena->offset;
-    arena->offset += size;
+
+    size_t pad = (size_t)(-(uintptr_t)(arena->base + arena->offset)) & (alignment - 1);
+    if (pad > arena->size - arena->offset || size > arena->size - arena->offset - pad) {
+        if (size + alignment < size || !arena_grow(arena, size + alignment)) {
+            arena->failed_allocs++;
+            return NULL;
+        }
+        pad = (size_t)(-(uintptr_t)(arena->base + arena->offset)) & (alignment - 1);
+    }
+
+    void* ptr = arena->base + arena->offset + pad;
+    arena->offset += pad + size;
+    arena->used += pad + size;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+    }
     return ptr;
 }
 
+void* _arena_alloc_impl(Arena* arena, size_t size) {
+    return arena_alloc_aligned(arena, size, ARENA_DEFAULT_ALIGNMENT);
+}
+
 void* arena_alloc(Arena* arena, size_t size) {
     return _arena_alloc_impl(arena, size);
 }
 
+static int size_class_floor(size_t size) {
+    int c = 0;
+    while (c + 1 < ARENA_SIZE_CLASSES && ((size_t)1 << (c + 1)) <= size) {
+        c++;
+    }
+    return c;
+}
+
+static int is_last_allocation(const Arena* arena, const void* ptr, size_t size) {
+    return (const char*)ptr + size == arena->base + arena->offset;
+}
+
+void arena_free(Arena* arena, void* ptr, size_t size) {
+    if (!arena || !ptr || size == 0) {
+        return;
+    }
+    if (is_last_allocation(arena, ptr, size)) {
+        arena->offset -= size;
+        arena->used -= size;
+        return;
+    }
+    const int c = size_class_floor(size);
+    if (c < ARENA_MIN_FREE_CLASS || ((uintptr_t)ptr & (ARENA_DEFAULT_ALIGNMENT - 1)) != 0) {
+        return;
+    }
+    ArenaFreeRange* range = (ArenaFreeRange*)ptr;
+    range->size = size;
+    range->next = arena->free_lists[c];
+    arena->free_lists[c] = range;
+    arena->free_bytes += size;
+}
+
+// First range of at least `size` bytes with the right alignment, from the
+// request's own class (where a range has to be checked, so a buffer freed at
+// the same size is found) and the two above it, which are guaranteed to fit;
+// bigger ones are left for bigger requests.
+static void* take_free_range(Arena* arena, size_t size, size_t alignment) {
+    const int c = size_class_floor(size);
+    for (int k = c; k < c + 3 && k < ARENA_SIZE_CLASSES; k++) {
+        for (ArenaFreeRange** link = &arena->free_lists[k]; *link; link = &(*link)->next) {
+            ArenaFreeRange* range = *link;
+            if (range->size >= size && ((uintptr_t)range & (alignment - 1)) == 0) {
+                *link = range->next;
+                arena->free_bytes -= range->size;
+                return range;
+            }
+        }
+    }
+    return NULL;
+}
+
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size, size_t alignment) {
+    if (!arena) {
+        return NULL;
+    }
+    if (ptr && new_size <= old_size) {
+        return ptr;
+    }
+    if (ptr && is_last_allocation(arena, ptr, old_size) && new_size - old_size <= arena->size - arena->offset) {
+        arena->offset += new_size - old_size;
+        arena->used += new_size - old_size;
+        if (arena->used > arena->high_water) {
+            arena->high_water = arena->used;
+        }
+        return ptr;
+    }
+
+    void* fresh = take_free_range(arena, new_size, alignment);
+    if (!fresh) {
+        fresh = arena_alloc_aligned(arena, new_size, alignment);
+        if (!fresh) {
+            return NULL;
+        }
+    }
+    if (ptr) {
+        memcpy(fresh, ptr, old_size);
+        arena_free(arena, ptr, old_size);
+    }
+    return fresh;
+}
+
 void _arena_dealloc_impl(Arena* arena, size_t size) {
-    if (!arena || sizeof(Arena) + size > arena->offset) {
+    if (!arena) {
+        return;
+    }
+    const size_t header = arena->base == (char*)arena ? sizeof(Arena) : sizeof(ArenaBlock);
+    if (header + size > arena->offset) {
         return;
     }
     arena->offset -= size;
+    arena->used -= size;
 }
 
 void arena_dealloc(Arena* arena, size_t size) {
     _arena_dealloc_impl(arena, size);
 }
 
+ArenaMark arena_mark(const Arena* arena) {
+    return (ArenaMark){
+        .block = arena->base == (char*)arena ? NULL : (ArenaBlock*)arena->base,
+        .offset = arena->offset,
+        .used = arena->used,
+    };
+}
+
+void arena_rewind(Arena* arena, ArenaMark mark) {
+    while (arena->blocks && arena->blocks != mark.block) {
+        ArenaBlock* block = arena->blocks;
+        arena->blocks = block->prev;
+        block->prev = arena->spare;
+        arena->spare = block;
+    }
+
+    if (mark.block) {
+        arena->base = (char*)mark.block;
+        arena->size = mark.block->size;
+    } else {
+        arena->base = (char*)arena;
+        arena->size = arena->first_size;
+    }
+    arena->offset = mark.offset;
+    arena->used = mark.used;
+    memset(arena->free_lists, 0, sizeof(arena->free_lists));
+    arena->free_bytes = 0;
+}
+
+void arena_reset(Arena* arena) {
+    arena_rewind(arena, (ArenaMark){.block = NULL, .offset = sizeof(Arena), .used = 0});
+}
+
 Arena* init_scratch_arena(Arena* base_arena, size_t size) {
-    return (Arena*)arena_alloc(base_arena, size + sizeof(Arena));
+    Arena* scratch = (Arena*)arena_alloc(base_arena, size + sizeof(Arena));
+    if (!scratch) {
+        return NULL;
+    }
+    arena_setup(scratch, size + sizeof(Arena));
+    return scratch;
 }
 
 void free_scratch_arena(Arena* base_arena, Arena* scratch_arena) {
     if (!base_arena || !scratch_arena) {
         return;
     }
-    arena_dealloc(base_arena, scratch_arena->size);
+    free_block_list(scratch_arena->blocks);
+    free_block_list(scratch_arena->spare);
+    // The scratch space only goes back to the base arena if nothing was allocated after it.
+    if ((char*)scratch_arena + scratch_arena->first_size == base_arena->base + base_arena->offset) {
+        arena_dealloc(base_arena, scratch_arena->first_size);
+    }
 }
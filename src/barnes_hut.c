@@ -0,0 +1,225 @@
+#include "barnes_hut.h"
+
+#include <math.h>
+
+#define QUADTREE_STACK_SIZE (3 * QUADTREE_MAX_DEPTH + 8)
+
+static int32_t quadtree_new_node(QuadTree* tree, Arena* arena,
+                                 double center_x, double center_y, double half_size) {
+    QuadNode node = {
+        .center_x = center_x,
+        .center_y = center_y,
+        .half_size = half_size,
+        .children = {QUADTREE_NO_NODE, QUADTREE_NO_NODE, QUADTREE_NO_NODE, QUADTREE_NO_NODE},
+        .first_body = -1,
+        .is_leaf = true,
+    };
+    size_t before = tree->nodes.length;
+    array_push(&tree->nodes, node, arena);
+    if (tree->nodes.length == before) {
+        return QUADTREE_NO_NODE;
+    }
+    return (int32_t)before;
+}
+
+static int quadtree_quadrant(const QuadNode* node, double x, double y) {
+    return (x >= node->center_x ? 1 : 0) | (y >= node->center_y ? 2 : 0);
+}
+
+static int32_t quadtree_child(QuadTree* tree, Arena* arena, int32_t parent, int quadrant) {
+    const QuadNode* node = &tree->nodes.data[parent];
+    const double quarter = node->half_size * 0.5;
+    const double cx = node->center_x + ((quadrant & 1) ? quarter : -quarter);
+    const double cy = node->center_y + ((quadrant & 2) ? quarter : -quarter);
+
+    int32_t child = quadtree_new_node(tree, arena, cx, cy, quarter);
+    if (child != QUADTREE_NO_NODE) {
+        // The push above may have moved the node array.
+        tree->nodes.data[parent].children[quadrant] = child;
+    }
+    return child;
+}
+
+static bool quadtree_insert(QuadTree* tree, Arena* arena, int32_t body) {
+    const double x = tree->x[body];
+    const double y = tree->y[body];
+    int32_t current = 0;
+    int depth = 0;
+
+    for (;;) {
+        QuadNode* node = &tree->nodes.data[current];
+
+        if (node->is_leaf) {
+            if (node->first_body < 0 || depth >= QUADTREE_MAX_DEPTH) {
+                // Empty leaf, or coincident bodies we can no longer separate.
+                tree->next_body[body] = node->first_body;
+                node->first_body = body;
+                return true;
+            }
+
+            // Split: push the resident body one level down, then keep descending.
+            int32_t resident = node->first_body;
+            int quadrant = quadtree_quadrant(node, tree->x[resident], tree->y[resident]);
+            node->first_body = -1;
+            node->is_leaf = false;
+
+            int32_t child = quadtree_child(tree, arena, current, quadrant);
+            if (child == QUADTREE_NO_NODE) {
+                return false;
+            }
+            tree->nodes.data[child].first_body = resident;
+            continue;
+        }
+
+        int quadrant = quadtree_quadrant(node, x, y);
+        int32_t next = node->children[quadrant];
+        if (next == QUADTREE_NO_NODE) {
+            next = quadtree_child(tree, arena, current, quadrant);
+            if (next == QUADTREE_NO_NODE) {
+                return false;
+            }
+            tree->next_body[body] = -1;
+            tree->nodes.data[next].first_body = body;
+            return true;
+        }
+        current = next;
+        depth += 1;
+    }
+}
+
+bool quadtree_build(QuadTree* tree, const double* x, const double* y, const double* mass,
+                    size_t count, Arena* arena) {
+    tree->x = x;
+    tree->y = y;
+    tree->mass = mass;
+    tree->body_count = count;
+    tree->nodes = (Array_QuadNode){0};
+    tree->next_body = NULL;
+    if (count == 0) {
+        return false;
+    }
+
+    double min_x = x[0], max_x = x[0];
+    double min_y = y[0], max_y = y[0];
+    for (size_t i = 1; i < count; i++) {
+        if (x[i] < min_x) min_x = x[i];
+        if (x[i] > max_x) max_x = x[i];
+        if (y[i] < min_y) min_y = y[i];
+        if (y[i] > max_y) max_y = y[i];
+    }
+
+    double half_size = 0.5 * fmax(max_x - min_x, max_y - min_y);
+    if (half_size <= 0.0) {
+        half_size = 1.0;
+    }
+    // Pad slightly so bodies on the max edge still fall inside the root cell.
+    half_size *= 1.0001;
+
+    tree->next_body = (int32_t*)arena_alloc(arena, count * sizeof(int32_t));
+    if (!tree->next_body) {
+        return false;
+    }
+    array_init(&tree->nodes, 2 * count + 1, arena);
+    if (!tree->nodes.data) {
+        return false;
+    }
+
+    if (quadtree_new_node(tree, arena, 0.5 * (min_x + max_x), 0.5 * (min_y + max_y), half_size) != 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!quadtree_insert(tree, arena, (int32_t)i)) {
+            return false;
+        }
+    }
+
+    // Children always have larger indices than their parent, so a reverse sweep
+    // sees every subtree before the node that owns it.
+    for (size_t n = tree->nodes.length; n-- > 0;) {
+        QuadNode* node = &tree->nodes.data[n];
+        double mass = 0.0, mx = 0.0, my = 0.0;
+
+        if (node->is_leaf) {
+            for (int32_t b = node->first_body; b >= 0; b = tree->next_body[b]) {
+                mass += tree->mass[b];
+                mx += tree->mass[b] * tree->x[b];
+                my += tree->mass[b] * tree->y[b];
+            }
+        } else {
+            for (int q = 0; q < 4; q++) {
+                int32_t c = node->children[q];
+                if (c == QUADTREE_NO_NODE) continue;
+                const QuadNode* child = &tree->nodes.data[c];
+                mass += child->mass;
+                mx += child->mass * child->com_x;
+                my += child->mass * child->com_y;
+            }
+        }
+
+        node->mass = mass;
+        if (mass > 0.0) {
+            node->com_x = mx / mass;
+            node->com_y = my / mass;
+        } else {
+            node->com_x = node->center_x;
+            node->com_y = node->center_y;
+        }
+    }
+
+    return true;
+}
+
+void quadtree_field(const QuadTree* tree, double px, double py, int32_t exclude,
+                    double theta, double* out_x, double* out_y) {
+    const double x = px;
+    const double y = py;
+    const double theta2 = theta * theta;
+    double fx = 0.0, fy = 0.0;
+
+    int32_t stack[QUADTREE_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const QuadNode* node = &tree->nodes.data[stack[--top]];
+        if (node->mass <= 0.0) continue;
+
+        if (node->is_leaf) {
+            for (int32_t b = node->first_body; b >= 0; b = tree->next_body[b]) {
+                if (b == exclude) continue;
+                const double dx = tree->x[b] - x;
+                const double dy = tree->y[b] - y;
+                const double dist2 = dx * dx + dy * dy;
+                if (dist2 <= 0.0) continue;
+                const double inv_dist3 = 1.0 / (dist2 * sqrt(dist2));
+                fx += tree->mass[b] * inv_dist3 * dx;
+                fy += tree->mass[b] * inv_dist3 * dy;
+            }
+            continue;
+        }
+
+        const double dx = node->com_x - x;
+        const double dy = node->com_y - y;
+        const double dist2 = dx * dx + dy * dy;
+        const double size = 2.0 * node->half_size;
+        const bool contains_target = fabs(x - node->center_x) <= node->half_size &&
+                                     fabs(y - node->center_y) <= node->half_size;
+
+        if (!contains_target && size * size < theta2 * dist2) {
+            const double inv_dist3 = 1.0 / (dist2 * sqrt(dist2));
+            fx += node->mass * inv_dist3 * dx;
+            fy += node->mass * inv_dist3 * dy;
+            continue;
+        }
+
+        for (int q = 0; q < 4; q++) {
+            if (node->children[q] != QUADTREE_NO_NODE) {
+                stack[top++] = node->children[q];
+            }
+        }
+    }
+
+    *out_x = fx;
+    *out_y = fy;
+}
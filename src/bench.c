@@ -0,0 +1,431 @@
+#include "sim.h"
+#include "sim_clock.h"
+#include "gravity.h"
+#include "sim_render.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * fizyka-bench: throughput of sim_compute_accelerations and sim_step.
+ *
+ * Runs every combination of seed, body count, solver and integrator selected on
+ * the command line and prints one JSON document to stdout. Each measurement
+ * repeats until --min-seconds of wall time have passed, so small systems get
+ * many samples and the 100k direct sum gets one.
+ *
+ * Interaction counts are direct-sum equivalents, N*(N-1) + particles*N per
+ * force pass, for every solver. For Barnes-Hut they are therefore an effective
+ * rate, which is what makes the solvers comparable at one body count.
+ *
+ * --render times sim_render_build instead, on the solar system after
+ * RENDER_YEARS of simulated time have filled its trails, plus a belt of
+ * RENDER_PARTICLES test particles.
+ */
+
+#define AU 1.496e11
+#define MAX_SIZES 16
+// The arena chains further blocks of this size as the scenario grows.
+#define BENCH_ARENA_BLOCK (16 * 1024 * 1024)
+#define RENDER_YEARS 20
+#define RENDER_PARTICLES 100000
+
+typedef enum {
+    SEED_RANDOM,  // equal-ish masses on a 10 AU disk
+    SEED_SOLAR,   // the solar system plus massive asteroids between 2 and 30 AU
+} Seed;
+
+static const char* seed_names[] = {"random", "solar"};
+
+typedef struct {
+    bool seeds[2];
+    bool solvers[2];
+    bool integrators[2];
+    size_t sizes[MAX_SIZES];
+    int size_count;
+    int threads;
+    double dt;
+    double min_seconds;
+    bool render;
+} Options;
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --seeds random,solar               seeds to run (default both)\n"
+            "  --sizes 10,100,1000,10000,100000   body counts (default)\n"
+            "  --solvers direct,barnes-hut        solvers to run (default both)\n"
+            "  --integrators verlet,wh            integrators to run (default both)\n"
+            "  --threads N                        worker threads, 0 = all CPUs (default 0)\n"
+            "  --kernel scalar|avx2|avx512        force a gravity kernel (default: widest supported)\n"
+            "  --dt SECONDS                       step size (default 3600)\n"
+            "  --min-seconds S                    wall time per measurement (default 0.5)\n"
+            "  --render                           time drawing geometry instead of physics\n",
+            argv0);
+}
+
+// Marks each comma-separated name in `list` that appears in `names`.
+static bool parse_set(const char* list, const char* const* names, int name_count, bool* out) {
+    memset(out, 0, (size_t)name_count * sizeof(bool));
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", list);
+    for (char* token = strtok(buffer, ","); token; token = strtok(NULL, ",")) {
+        int found = -1;
+        for (int i = 0; i < name_count; i++) {
+            if (strcmp(token, names[i]) == 0) found = i;
+        }
+        if (found < 0) {
+            fprintf(stderr, "unknown name '%s'\n", token);
+            return false;
+        }
+        out[found] = true;
+    }
+    return true;
+}
+
+static bool parse_options(int argc, char** argv, Options* opts) {
+    static const char* solver_names[] = {"direct", "barnes-hut"};
+    static const char* integrator_names[] = {"verlet", "wh"};
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            usage(argv[0]);
+            exit(0);
+        }
+        if (strcmp(arg, "--render") == 0) {
+            opts->render = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(arg, "--seeds") == 0) {
+            if (!parse_set(value, seed_names, 2, opts->seeds)) return false;
+        } else if (strcmp(arg, "--solvers") == 0) {
+            if (!parse_set(value, solver_names, 2, opts->solvers)) return false;
+        } else if (strcmp(arg, "--integrators") == 0) {
+            if (!parse_set(value, integrator_names, 2, opts->integrators)) return false;
+        } else if (strcmp(arg, "--sizes") == 0) {
+            opts->size_count = 0;
+            char* end = (char*)value;
+            while (*end && opts->size_count < MAX_SIZES) {
+                size_t size = (size_t)strtoull(end, &end, 10);
+                if (size > 0) opts->sizes[opts->size_count++] = size;
+                if (*end == ',') end++;
+                else if (*end) return false;
+            }
+        } else if (strcmp(arg, "--threads") == 0) {
+            opts->threads = atoi(value);
+        } else if (strcmp(arg, "--kernel") == 0) {
+            GravityKernel kernel;
+            if (strcmp(value, "scalar") == 0) kernel = GRAVITY_KERNEL_SCALAR;
+            else if (strcmp(value, "avx2") == 0) kernel = GRAVITY_KERNEL_AVX2;
+            else if (strcmp(value, "avx512") == 0) kernel = GRAVITY_KERNEL_AVX512;
+            else return false;
+            if (!gravity_set_kernel(kernel)) {
+                fprintf(stderr, "kernel %s is not supported on this CPU\n", value);
+                return false;
+            }
+        } else if (strcmp(arg, "--dt") == 0) {
+            opts->dt = strtod(value, NULL);
+        } else if (strcmp(arg, "--min-seconds") == 0) {
+            opts->min_seconds = strtod(value, NULL);
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+    }
+    return opts->size_count > 0 && opts->dt > 0.0;
+}
+
+static void seed(SimContext* sim, Seed kind, size_t count) {
+    if (kind == SEED_RANDOM) {
+        sim_seed_random_disk(sim, count, 10.0 * AU, 1);
+        return;
+    }
+    sim_seed_solar_system(sim);
+    size_t have = sim_body_count(sim);
+    if (count > have) {
+        sim_add_body_ring(sim, sim_body_id(sim, 0), 2.0 * AU, 30.0 * AU, count - have, 1.0e18,
+                          (SimColor){150, 140, 120, 255}, 1);
+    }
+}
+
+typedef struct {
+    double seconds;  // mean wall time per call
+    long calls;
+    unsigned long evaluations;  // force passes across all calls
+} Timing;
+
+static Timing time_accelerations(SimContext* sim, double min_seconds) {
+    Timing t = {0};
+    unsigned long before = sim->force_evaluations;
+    double start = sim_clock_now();
+    double elapsed;
+    do {
+        sim_invalidate_accelerations(sim);
+        sim_compute_accelerations(sim);
+        t.calls++;
+        elapsed = sim_clock_now() - start;
+    } while (elapsed < min_seconds);
+    t.seconds = elapsed / (double)t.calls;
+    t.evaluations = sim->force_evaluations - before;
+    return t;
+}
+
+static Timing time_steps(SimContext* sim, double dt, double min_seconds) {
+    Timing t = {0};
+    unsigned long before = sim->force_evaluations;
+    double start = sim_clock_now();
+    double elapsed;
+    do {
+        sim_step(sim, dt);
+        t.calls++;
+        elapsed = sim_clock_now() - start;
+    } while (elapsed < min_seconds);
+    t.seconds = elapsed / (double)t.calls;
+    t.evaluations = sim->force_evaluations - before;
+    return t;
+}
+
+static void print_timing(const char* name, const Timing* t, double pairs_per_pass) {
+    double per_call = (double)t->evaluations / (double)t->calls * pairs_per_pass;
+    double per_second = t->seconds > 0.0 ? per_call / t->seconds : 0.0;
+    printf("\"%s\": {\"calls\": %ld, \"seconds_per_call\": %.9g, \"calls_per_second\": %.6g, "
+           "\"force_passes_per_call\": %.6g, \"interactions_per_second\": %.6g, \"ns_per_interaction\": %.6g}",
+           name, t->calls, t->seconds, t->seconds > 0.0 ? 1.0 / t->seconds : 0.0,
+           (double)t->evaluations / (double)t->calls, per_second,
+           per_second > 0.0 ? 1e9 / per_second : 0.0);
+}
+
+static bool run_case(const Options* opts, Seed kind, size_t size, SimSolver solver, SimIntegrator integrator,
+                     bool first) {
+    Arena* arena = init_arena(BENCH_ARENA_BLOCK);
+    if (!arena) {
+        fprintf(stderr, "could not allocate the arena\n");
+        return false;
+    }
+
+    SimContext sim = {0};
+    sim_init_empty(&sim, arena);
+    sim.trail_length = 0;
+    sim.solver = solver;
+    sim.integrator = integrator;
+    sim_set_thread_count(&sim, opts->threads);
+    seed(&sim, kind, size);
+    size_t seeded_bytes = arena->used;
+
+    const double n = (double)sim_body_count(&sim);
+    const double pairs_per_pass = n * (n - 1.0) + (double)sim_particle_count(&sim) * n;
+
+    Timing accel = time_accelerations(&sim, opts->min_seconds);
+    Timing step = time_steps(&sim, opts->dt, opts->min_seconds);
+
+    printf("%s\n    {\"seed\": \"%s\", \"bodies\": %zu, \"particles\": %zu, \"solver\": \"%s\", "
+           "\"integrator\": \"%s\", \"threads\": %d,\n     ",
+           first ? "" : ",", seed_names[kind], sim_body_count(&sim), sim_particle_count(&sim),
+           solver == SIM_SOLVER_BARNES_HUT ? "barnes-hut" : "direct",
+           integrator == SIM_INTEGRATOR_WISDOM_HOLMAN ? "wh" : "verlet", sim.thread_count);
+    print_timing("accelerations", &accel, pairs_per_pass);
+    printf(",\n     ");
+    print_timing("step", &step, pairs_per_pass);
+    printf(",\n     \"arena_bytes_seeded\": %zu, \"arena_bytes_used\": %zu, \"arena_bytes_peak\": %zu, "
+           "\"arena_failed_allocs\": %zu}",
+           seeded_bytes, arena->used, arena->high_water, arena->failed_allocs);
+    fflush(stdout);
+
+    sim_shutdown(&sim);
+    free_arena(arena);
+    return true;
+}
+
+// Rough width of raylib's default font, which is about 0.6 em per glyph.
+static int measure_text(const char* text, int font_size, void* user) {
+    (void)user;
+    return (int)strlen(text) * font_size * 6 / 10;
+}
+
+// Times sim_render_build for `view`, rewinding `arena` after each call.
+static bool print_render_timing(const char* name, const SimContext* sim, const SimView* view, SimTextCache* text,
+                                Arena* arena, double min_seconds) {
+    size_t points = 0;
+    for (size_t i = 0; i < sim->trails.length; i++) {
+        points += sim->trails.data[i].count;
+    }
+
+    Timing t = {0};
+    SimRenderList list;
+    bool ok;
+    const ArenaMark mark = arena_mark(arena);
+    double start = sim_clock_now();
+    double elapsed;
+    do {
+        arena_rewind(arena, mark);
+        ok = sim_render_build(sim, view, text, arena, &list);
+        t.calls++;
+        elapsed = sim_clock_now() - start;
+    } while (ok && elapsed < min_seconds);
+    t.seconds = elapsed / (double)t.calls;
+
+    printf("\"%s\": {\"trail_points\": %zu, \"line_vertices\": %zu, \"quads\": %zu, \"circles\": %zu, "
+           "\"labels\": %zu, \"calls\": %ld, \"seconds_per_call\": %.9g, \"trail_points_per_ms\": %.6g}",
+           name, points, list.lines.length, list.quads.length, list.circles.length, list.labels.length, t.calls,
+           t.seconds, t.seconds > 0.0 ? (double)points / (t.seconds * 1e3) : 0.0);
+    arena_rewind(arena, mark);
+    return ok;
+}
+
+// Times sim_splat_build plus sim_splat_tonemap, the density mode's frame.
+static bool print_splat_timing(const char* name, const SimContext* sim, const SimView* view, Arena* arena,
+                               double min_seconds) {
+    Timing t = {0};
+    SimSplat splat;
+    size_t lit = 0;
+    bool ok;
+    const ArenaMark mark = arena_mark(arena);
+    double start = sim_clock_now();
+    double elapsed;
+    do {
+        arena_rewind(arena, mark);
+        ok = sim_splat_build(sim, view, arena, &splat);
+        SimColor* pixels = (SimColor*)arena_alloc(arena, (size_t)splat.width * (size_t)splat.height * sizeof(SimColor));
+        ok = ok && pixels;
+        if (ok) {
+            sim_splat_tonemap(sim, &splat, pixels);
+        }
+        t.calls++;
+        elapsed = sim_clock_now() - start;
+    } while (ok && elapsed < min_seconds);
+    t.seconds = elapsed / (double)t.calls;
+
+    if (ok) {
+        for (size_t i = 0; i < (size_t)splat.width * (size_t)splat.height; i++) {
+            lit += splat.counts[i] != 0;
+        }
+    }
+    printf("\"%s\": {\"lit_pixels\": %zu, \"max_count\": %u, \"calls\": %ld, \"seconds_per_call\": %.9g}",
+           name, lit, splat.max_count, t.calls, t.seconds);
+    arena_rewind(arena, mark);
+    return ok;
+}
+
+// Fills the solar system's trails and adds an asteroid belt of test particles,
+// then times building a frame's render commands for a 1920x1080 view of the
+// inner 30 AU and for one of the Earth-Moon system, and the density mode's
+// frame for the first view.
+static bool run_render(const Options* opts) {
+    Arena* arena = init_arena(BENCH_ARENA_BLOCK);
+    if (!arena) {
+        fprintf(stderr, "could not allocate the arena\n");
+        return false;
+    }
+
+    SimContext sim = {0};
+    sim_init_empty(&sim, arena);
+    sim_set_thread_count(&sim, opts->threads);
+    sim_seed_solar_system(&sim);
+    const long steps = (long)(RENDER_YEARS * 365.25 * 86400.0 / opts->dt);
+    for (long i = 0; i < steps; i++) {
+        sim_step(&sim, opts->dt);
+    }
+    // Added after stepping: they only need to be drawn.
+    sim_add_particle_ring(&sim, sim_body_id(&sim, 0), 2.2 * AU, 3.3 * AU, RENDER_PARTICLES,
+                          (SimColor){150, 140, 120, 255}, 1);
+
+    const PhysicalBody earth = sim_get_body(&sim, sim_body_id(&sim, 3));
+    const SimView system_view = {
+        .cam_x = 0.0,
+        .cam_y = 0.0,
+        .zoom = 1080.0 / (60.0 * AU),
+        .screen_w = 1920,
+        .screen_h = 1080,
+        .blend = 0.0,
+    };
+    const SimView earth_view = {
+        .cam_x = earth.x,
+        .cam_y = earth.y,
+        .zoom = 1080.0 / 1.0e9,
+        .screen_w = 1920,
+        .screen_h = 1080,
+        .blend = 0.0,
+    };
+
+    printf("{\"dt\": %g, \"min_seconds\": %g, \"render\": {\"bodies\": %zu, \"particles\": %zu, "
+           "\"sim_years\": %d,\n ",
+           opts->dt, opts->min_seconds, sim_body_count(&sim), sim_particle_count(&sim), RENDER_YEARS);
+    sim_begin_frame(&sim);
+    Arena* frame = sim_frame_arena(&sim);
+    if (!frame) {
+        fprintf(stderr, "could not allocate the frame arena\n");
+        sim_shutdown(&sim);
+        free_arena(arena);
+        return false;
+    }
+    SimTextCache text;
+    sim_text_cache_init(&text, measure_text, NULL, arena);
+    bool ok = print_render_timing("system_view", &sim, &system_view, &text, frame, opts->min_seconds);
+    printf(",\n ");
+    ok = print_render_timing("earth_view", &sim, &earth_view, &text, frame, opts->min_seconds) && ok;
+    printf(",\n ");
+    ok = print_splat_timing("system_splat", &sim, &system_view, frame, opts->min_seconds) && ok;
+    printf("}}\n");
+    if (!ok) {
+        fprintf(stderr, "the arena ran out while building render commands\n");
+    }
+
+    sim_shutdown(&sim);
+    free_arena(arena);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    Options opts = {
+        .seeds = {true, true},
+        .solvers = {true, true},
+        .integrators = {true, true},
+        .sizes = {10, 100, 1000, 10000, 100000},
+        .size_count = 5,
+        .threads = 0,
+        .dt = 3600.0,
+        .min_seconds = 0.5,
+    };
+    if (!parse_options(argc, argv, &opts)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (opts.threads <= 0) {
+        opts.threads = worker_pool_cpu_count();
+    }
+    if (opts.render) {
+        return run_render(&opts) ? 0 : 1;
+    }
+
+    printf("{\"kernel\": \"%s\", \"cpu_count\": %d, \"dt\": %g, \"min_seconds\": %g, \"results\": [",
+           gravity_kernel_name(gravity_kernel()), worker_pool_cpu_count(), opts.dt, opts.min_seconds);
+
+    bool first = true;
+    for (int s = 0; s < 2; s++) {
+        if (!opts.seeds[s]) continue;
+        for (int i = 0; i < opts.size_count; i++) {
+            for (int solver = 0; solver < 2; solver++) {
+                if (!opts.solvers[solver]) continue;
+                for (int integrator = 0; integrator < 2; integrator++) {
+                    if (!opts.integrators[integrator]) continue;
+                    if (!run_case(&opts, (Seed)s, opts.sizes[i], (SimSolver)solver,
+                                  (SimIntegrator)integrator, first)) {
+                        printf("\n]}\n");
+                        return 1;
+                    }
+                    first = false;
+                }
+            }
+        }
+    }
+    printf("\n]}\n");
+    return 0;
+}
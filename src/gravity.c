@@ -0,0 +1,438 @@
+#include "gravity.h"
+
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GRAVITY_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define GRAVITY_HAVE_X86_SIMD 0
+#endif
+
+typedef void (*GravityRowsFn)(const double* x, const double* y, const double* mass, size_t count,
+                              const double* tx, const double* ty, size_t begin, size_t end,
+                              double* out_x, double* out_y);
+
+void gravity_field_pairwise(const double* x, const double* y, const double* mass, size_t count,
+                            double* out_x, double* out_y) {
+    for (size_t i = 0; i < count; i++) {
+        out_x[i] = 0.0;
+        out_y[i] = 0.0;
+    }
+
+    for (size_t i = 0; i < count; i += 1) {
+        for (size_t j = i + 1; j < count; j += 1) {
+            const double dx = x[j] - x[i];
+            const double dy = y[j] - y[i];
+            const double dist2 = dx * dx + dy * dy;
+            if (dist2 <= 0.0) continue;
+            const double dist = sqrt(dist2);
+            const double inv_dist3 = 1.0 / (dist2 * dist);
+
+            const double field_i = mass[j] * inv_dist3;
+            const double field_j = mass[i] * inv_dist3;
+
+            out_x[i] += field_i * dx;
+            out_y[i] += field_i * dy;
+            out_x[j] -= field_j * dx;
+            out_y[j] -= field_j * dy;
+        }
+    }
+}
+
+typedef struct {
+    const double* x;
+    const double* y;
+    const double* mass;
+    size_t count;
+    size_t tile_count;
+    const size_t* first_row;  // tile_count + 1 row boundaries
+    double** buf_x;           // per tile, indexed from first_row[tile]; tile 0's is the output
+    double** buf_y;
+} PairTileJob;
+
+static void pair_tile_task(void* ctx, size_t tile, int worker_index) {
+    (void)worker_index;
+    const PairTileJob* job = (const PairTileJob*)ctx;
+    const double* x = job->x;
+    const double* y = job->y;
+    const double* mass = job->mass;
+    const size_t base = job->first_row[tile];
+    const size_t row_end = job->first_row[tile + 1];
+    double* out_x = job->buf_x[tile] - base;
+    double* out_y = job->buf_y[tile] - base;
+
+    for (size_t i = base; i < job->count; i++) {
+        out_x[i] = 0.0;
+        out_y[i] = 0.0;
+    }
+    for (size_t i = base; i < row_end; i += 1) {
+        for (size_t j = i + 1; j < job->count; j += 1) {
+            const double dx = x[j] - x[i];
+            const double dy = y[j] - y[i];
+            const double dist2 = dx * dx + dy * dy;
+            if (dist2 <= 0.0) continue;
+            const double dist = sqrt(dist2);
+            const double inv_dist3 = 1.0 / (dist2 * dist);
+
+            const double field_i = mass[j] * inv_dist3;
+            const double field_j = mass[i] * inv_dist3;
+
+            out_x[i] += field_i * dx;
+            out_y[i] += field_i * dy;
+            out_x[j] -= field_j * dx;
+            out_y[j] -= field_j * dy;
+        }
+    }
+}
+
+// Adds tiles 1.. into tile 0's buffer, in tile order, for one block of bodies.
+static void pair_reduce_task(void* ctx, size_t block, int worker_index) {
+    (void)worker_index;
+    const PairTileJob* job = (const PairTileJob*)ctx;
+    const size_t begin = block * GRAVITY_TILE_SOURCES;
+    const size_t end = begin + GRAVITY_TILE_SOURCES < job->count ? begin + GRAVITY_TILE_SOURCES : job->count;
+    double* out_x = job->buf_x[0];
+    double* out_y = job->buf_y[0];
+
+    for (size_t t = 1; t < job->tile_count; t++) {
+        const size_t base = job->first_row[t];
+        const size_t from = begin > base ? begin : base;
+        for (size_t k = from; k < end; k++) {
+            out_x[k] += job->buf_x[t][k - base];
+            out_y[k] += job->buf_y[t][k - base];
+        }
+    }
+}
+
+void gravity_field_pairwise_tiled(WorkerPool* pool, const double* x, const double* y, const double* mass,
+                                  size_t count, double* out_x, double* out_y, Arena* scratch) {
+    const double pairs = (double)count * ((double)count - 1.0) * 0.5;
+    const double budget = (double)GRAVITY_PAIR_SCRATCH_BYTES / ((double)count * 2.0 * sizeof(double) + 1.0);
+    double tiles = fmin(GRAVITY_PAIR_TILES, fmin(pairs / GRAVITY_PAIR_TILE_MIN_PAIRS, budget + 1.0));
+    const size_t tile_count = tiles > 1.0 ? (size_t)tiles : 1;
+    if (tile_count == 1) {
+        gravity_field_pairwise(x, y, mass, count, out_x, out_y);
+        return;
+    }
+
+    ArenaMark arena_start = arena_mark(scratch);
+    size_t* first_row = (size_t*)arena_alloc(scratch, (tile_count + 1) * sizeof(size_t));
+    double** buf_x = (double**)arena_alloc(scratch, tile_count * sizeof(double*));
+    double** buf_y = (double**)arena_alloc(scratch, tile_count * sizeof(double*));
+    bool ok = first_row && buf_x && buf_y;
+
+    if (ok) {
+        // Row i pairs with the count - 1 - i bodies after it; cut the rows
+        // where the running pair count passes each tile's share.
+        size_t tile = 0;
+        double before = 0.0;
+        first_row[0] = 0;
+        for (size_t i = 0; i < count && tile + 1 < tile_count; i++) {
+            if (before >= pairs * (double)(tile + 1) / (double)tile_count) {
+                first_row[++tile] = i;
+            }
+            before += (double)(count - 1 - i);
+        }
+        while (tile + 1 < tile_count) {
+            first_row[++tile] = count;
+        }
+        first_row[tile_count] = count;
+
+        buf_x[0] = out_x;
+        buf_y[0] = out_y;
+        for (size_t t = 1; t < tile_count && ok; t++) {
+            const size_t length = count - first_row[t];
+            buf_x[t] = (double*)arena_alloc(scratch, (length + 1) * sizeof(double));
+            buf_y[t] = (double*)arena_alloc(scratch, (length + 1) * sizeof(double));
+            ok = buf_x[t] && buf_y[t];
+        }
+    }
+
+    if (ok) {
+        PairTileJob job = {
+            .x = x,
+            .y = y,
+            .mass = mass,
+            .count = count,
+            .tile_count = tile_count,
+            .first_row = first_row,
+            .buf_x = buf_x,
+            .buf_y = buf_y,
+        };
+        worker_pool_run(pool, tile_count, pair_tile_task, &job);
+        worker_pool_run(pool, (count + GRAVITY_TILE_SOURCES - 1) / GRAVITY_TILE_SOURCES, pair_reduce_task, &job);
+    } else {
+        gravity_field_pairwise(x, y, mass, count, out_x, out_y);
+    }
+    arena_rewind(scratch, arena_start);
+}
+
+static void field_rows_scalar(const double* x, const double* y, const double* mass, size_t count,
+                              const double* tx, const double* ty, size_t begin, size_t end,
+                              double* out_x, double* out_y) {
+    for (size_t i = begin; i < end; i++) {
+        const double px = tx[i];
+        const double py = ty[i];
+        double fx = 0.0, fy = 0.0;
+        for (size_t j = 0; j < count; j++) {
+            const double dx = x[j] - px;
+            const double dy = y[j] - py;
+            const double dist2 = dx * dx + dy * dy;
+            if (dist2 <= 0.0) continue;
+            const double s = mass[j] / (dist2 * sqrt(dist2));
+            fx += s * dx;
+            fy += s * dy;
+        }
+        out_x[i] = fx;
+        out_y[i] = fy;
+    }
+}
+
+#if GRAVITY_HAVE_X86_SIMD
+
+// Newton step for y ~ 1/sqrt(x): y * (1.5 - 0.5 * x * y * y). Each step doubles
+// the number of correct bits of the hardware estimate.
+#define RSQRT_NEWTON_AVX2(y, half_x) \
+    _mm256_mul_pd((y), _mm256_fnmadd_pd((half_x), _mm256_mul_pd((y), (y)), three_halves))
+
+#define RSQRT_NEWTON_AVX512(y, half_x) \
+    _mm512_mul_pd((y), _mm512_fnmadd_pd((half_x), _mm512_mul_pd((y), (y)), three_halves))
+
+__attribute__((target("avx2,fma")))
+static void field_rows_avx2(const double* x, const double* y, const double* mass, size_t count,
+                            const double* tx, const double* ty, size_t begin, size_t end,
+                            double* out_x, double* out_y) {
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    // The estimate goes through single precision; outside this range use exact sqrt/div.
+    const __m256d float_min = _mm256_set1_pd(1e-30);
+    const __m256d float_max = _mm256_set1_pd(1e30);
+    const size_t vec_end = count & ~(size_t)3;
+
+    for (size_t i = begin; i < end; i++) {
+        const double px = tx[i];
+        const double py = ty[i];
+        const __m256d vpx = _mm256_set1_pd(px);
+        const __m256d vpy = _mm256_set1_pd(py);
+        __m256d fx = zero, fy = zero;
+
+        for (size_t j = 0; j < vec_end; j += 4) {
+            const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + j), vpx);
+            const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + j), vpy);
+            const __m256d dist2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+            const __m256d valid = _mm256_cmp_pd(dist2, zero, _CMP_GT_OQ);
+            const __m256d m = _mm256_loadu_pd(mass + j);
+            __m256d s;
+
+            const __m256d in_range = _mm256_and_pd(_mm256_cmp_pd(dist2, float_min, _CMP_GE_OQ),
+                                                   _mm256_cmp_pd(dist2, float_max, _CMP_LE_OQ));
+            if (_mm256_movemask_pd(in_range) == 0xF) {
+                const __m256d half_x = _mm256_mul_pd(half, dist2);
+                __m256d inv = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(dist2)));
+                inv = RSQRT_NEWTON_AVX2(inv, half_x);
+                inv = RSQRT_NEWTON_AVX2(inv, half_x);
+                inv = RSQRT_NEWTON_AVX2(inv, half_x);
+                s = _mm256_mul_pd(m, _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv)));
+            } else {
+                s = _mm256_and_pd(_mm256_div_pd(m, _mm256_mul_pd(dist2, _mm256_sqrt_pd(dist2))), valid);
+            }
+            s = _mm256_and_pd(s, valid);
+
+            fx = _mm256_fmadd_pd(s, dx, fx);
+            fy = _mm256_fmadd_pd(s, dy, fy);
+        }
+
+        double lanes_x[4], lanes_y[4];
+        _mm256_storeu_pd(lanes_x, fx);
+        _mm256_storeu_pd(lanes_y, fy);
+        double sum_x = ((lanes_x[0] + lanes_x[1]) + lanes_x[2]) + lanes_x[3];
+        double sum_y = ((lanes_y[0] + lanes_y[1]) + lanes_y[2]) + lanes_y[3];
+
+        for (size_t j = vec_end; j < count; j++) {
+            const double dx = x[j] - px;
+            const double dy = y[j] - py;
+            const double dist2 = dx * dx + dy * dy;
+            if (dist2 <= 0.0) continue;
+            const double s = mass[j] / (dist2 * sqrt(dist2));
+            sum_x += s * dx;
+            sum_y += s * dy;
+        }
+
+        out_x[i] = sum_x;
+        out_y[i] = sum_y;
+    }
+}
+
+__attribute__((target("avx512f")))
+static void field_rows_avx512(const double* x, const double* y, const double* mass, size_t count,
+                              const double* tx, const double* ty, size_t begin, size_t end,
+                              double* out_x, double* out_y) {
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d three_halves = _mm512_set1_pd(1.5);
+    const size_t vec_end = count & ~(size_t)7;
+    const __mmask8 tail = (__mmask8)((1u << (count - vec_end)) - 1u);
+
+    for (size_t i = begin; i < end; i++) {
+        const __m512d vpx = _mm512_set1_pd(tx[i]);
+        const __m512d vpy = _mm512_set1_pd(ty[i]);
+        __m512d fx = zero, fy = zero;
+
+        for (size_t j = 0; j < count; j += 8) {
+            const __mmask8 lanes = j < vec_end ? (__mmask8)0xFF : tail;
+            const __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, x + j), vpx);
+            const __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, y + j), vpy);
+            const __m512d dist2 = _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy));
+            const __mmask8 valid = _mm512_mask_cmp_pd_mask(lanes, dist2, zero, _CMP_GT_OQ);
+
+            // rsqrt14 covers the full double range, two Newton steps reach full precision.
+            const __m512d half_x = _mm512_mul_pd(half, dist2);
+            __m512d inv = _mm512_maskz_rsqrt14_pd(valid, dist2);
+            inv = RSQRT_NEWTON_AVX512(inv, half_x);
+            inv = RSQRT_NEWTON_AVX512(inv, half_x);
+            const __m512d s = _mm512_maskz_mul_pd(valid, _mm512_maskz_loadu_pd(lanes, mass + j),
+                                                  _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv)));
+
+            fx = _mm512_fmadd_pd(s, dx, fx);
+            fy = _mm512_fmadd_pd(s, dy, fy);
+        }
+
+        double lanes_x[8], lanes_y[8];
+        _mm512_storeu_pd(lanes_x, fx);
+        _mm512_storeu_pd(lanes_y, fy);
+        double sum_x = 0.0, sum_y = 0.0;
+        for (int k = 0; k < 8; k++) {
+            sum_x += lanes_x[k];
+            sum_y += lanes_y[k];
+        }
+
+        out_x[i] = sum_x;
+        out_y[i] = sum_y;
+    }
+}
+
+#endif
+
+static GravityKernel active_kernel;
+static GravityRowsFn active_rows;
+static bool kernel_resolved = false;
+
+bool gravity_kernel_supported(GravityKernel kernel) {
+    switch (kernel) {
+    case GRAVITY_KERNEL_SCALAR:
+        return true;
+#if GRAVITY_HAVE_X86_SIMD
+    case GRAVITY_KERNEL_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case GRAVITY_KERNEL_AVX512:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+const char* gravity_kernel_name(GravityKernel kernel) {
+    switch (kernel) {
+    case GRAVITY_KERNEL_SCALAR: return "scalar";
+    case GRAVITY_KERNEL_AVX2: return "avx2";
+    case GRAVITY_KERNEL_AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+bool gravity_set_kernel(GravityKernel kernel) {
+    if (!gravity_kernel_supported(kernel)) {
+        return false;
+    }
+    switch (kernel) {
+#if GRAVITY_HAVE_X86_SIMD
+    case GRAVITY_KERNEL_AVX2: active_rows = field_rows_avx2; break;
+    case GRAVITY_KERNEL_AVX512: active_rows = field_rows_avx512; break;
+#endif
+    default: active_rows = field_rows_scalar; break;
+    }
+    active_kernel = kernel;
+    kernel_resolved = true;
+    return true;
+}
+
+GravityKernel gravity_kernel(void) {
+    if (!kernel_resolved) {
+        if (!gravity_set_kernel(GRAVITY_KERNEL_AVX512) && !gravity_set_kernel(GRAVITY_KERNEL_AVX2)) {
+            gravity_set_kernel(GRAVITY_KERNEL_SCALAR);
+        }
+    }
+    return active_kernel;
+}
+
+void gravity_field_rows(const double* x, const double* y, const double* mass, size_t count,
+                        const double* tx, const double* ty, size_t begin, size_t end,
+                        double* out_x, double* out_y) {
+    gravity_kernel();
+    active_rows(x, y, mass, count, tx, ty, begin, end, out_x, out_y);
+}
+
+typedef struct {
+    const double* x;
+    const double* y;
+    const double* mass;
+    size_t count;
+    const double* tx;
+    const double* ty;
+    size_t target_count;
+    double* out_x;
+    double* out_y;
+} FieldTileJob;
+
+static void field_tile_task(void* ctx, size_t tile, int worker_index) {
+    (void)worker_index;
+    const FieldTileJob* job = (const FieldTileJob*)ctx;
+    const size_t begin = tile * GRAVITY_TILE_TARGETS;
+    const size_t rows = job->target_count - begin < GRAVITY_TILE_TARGETS
+                            ? job->target_count - begin : GRAVITY_TILE_TARGETS;
+
+    double acc_x[GRAVITY_TILE_TARGETS] = {0};
+    double acc_y[GRAVITY_TILE_TARGETS] = {0};
+    double part_x[GRAVITY_TILE_TARGETS];
+    double part_y[GRAVITY_TILE_TARGETS];
+
+    for (size_t j = 0; j < job->count; j += GRAVITY_TILE_SOURCES) {
+        const size_t sources = job->count - j < GRAVITY_TILE_SOURCES ? job->count - j : GRAVITY_TILE_SOURCES;
+        active_rows(job->x + j, job->y + j, job->mass + j, sources,
+                    job->tx + begin, job->ty + begin, 0, rows, part_x, part_y);
+        for (size_t r = 0; r < rows; r++) {
+            acc_x[r] += part_x[r];
+            acc_y[r] += part_y[r];
+        }
+    }
+
+    for (size_t r = 0; r < rows; r++) {
+        job->out_x[begin + r] = acc_x[r];
+        job->out_y[begin + r] = acc_y[r];
+    }
+}
+
+void gravity_field_tiled(WorkerPool* pool,
+                         const double* x, const double* y, const double* mass, size_t count,
+                         const double* tx, const double* ty, size_t target_count,
+                         double* out_x, double* out_y) {
+    gravity_kernel();
+    FieldTileJob job = {
+        .x = x,
+        .y = y,
+        .mass = mass,
+        .count = count,
+        .tx = tx,
+        .ty = ty,
+        .target_count = target_count,
+        .out_x = out_x,
+        .out_y = out_y,
+    };
+    const size_t tiles = (target_count + GRAVITY_TILE_TARGETS - 1) / GRAVITY_TILE_TARGETS;
+    worker_pool_run(pool, tiles, field_tile_task, &job);
+}
@@ -0,0 +1,372 @@
+#include "sim.h"
+#include "sim_clock.h"
+#include "gravity.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * fizyka-headless: runs the simulation library without a window.
+ *
+ * Seeds a scenario, takes --steps steps of --dt seconds and prints the final
+ * state followed by timing, one record per line, so runs can be diffed and
+ * scripted. --check-threads N repeats the run single-threaded and fails unless
+ * both runs end bitwise identical; --check-kernels compares every SIMD kernel
+ * and the tiled pair loop with the scalar reference. `make check` runs both.
+ */
+
+#define AU 1.496e11
+// The arena chains further blocks of this size as the scenario grows.
+#define HEADLESS_ARENA_BLOCK (16 * 1024 * 1024)
+
+typedef enum {
+    SCENARIO_SOLAR,   // the built-in solar system
+    SCENARIO_RANDOM,  // --bodies bodies on a random disk
+    SCENARIO_BELT,    // solar system plus --bodies test particles in the asteroid belt
+} Scenario;
+
+typedef struct {
+    Scenario scenario;
+    size_t bodies;
+    long steps;
+    double dt;
+    SimSolver solver;
+    double theta;
+    SimIntegrator integrator;
+    int threads;
+    int check_threads;
+    bool check_kernels;
+    unsigned long rng_seed;
+    bool dump_particles;
+    bool quiet;
+} Options;
+
+static const char* scenario_names[] = {"solar", "random", "belt"};
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --scenario solar|random|belt  initial state (default solar)\n"
+            "  --bodies N                    random bodies or belt particles (default 1000)\n"
+            "  --steps N                     steps to take (default 1000)\n"
+            "  --dt SECONDS                  step size (default 3600)\n"
+            "  --solver direct|barnes-hut    force solver (default direct)\n"
+            "  --theta T                     Barnes-Hut opening angle (default %g)\n"
+            "  --integrator verlet|wh        integrator (default verlet)\n"
+            "  --threads N                   worker threads, 0 = all CPUs (default 1)\n"
+            "  --kernel scalar|avx2|avx512   force a gravity kernel (default: widest supported)\n"
+            "  --rng-seed N                  seed for random scenarios (default 1)\n"
+            "  --check-threads N             also run with 1 thread and compare against N threads\n"
+            "  --check-kernels               compare the SIMD kernels and pair tiles with the scalar pair loop\n"
+            "  --dump-particles              print every test particle, not just the bodies\n"
+            "  --quiet                       print only the header, summary and checks, not the state\n",
+            argv0, SIM_DEFAULT_BH_THETA);
+}
+
+static bool parse_options(int argc, char** argv, Options* opts) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            usage(argv[0]);
+            exit(0);
+        }
+        if (strcmp(arg, "--dump-particles") == 0) {
+            opts->dump_particles = true;
+            continue;
+        }
+        if (strcmp(arg, "--check-kernels") == 0) {
+            opts->check_kernels = true;
+            continue;
+        }
+        if (strcmp(arg, "--quiet") == 0) {
+            opts->quiet = true;
+            continue;
+        }
+        if (!value) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return false;
+        }
+        i++;
+
+        if (strcmp(arg, "--scenario") == 0) {
+            if (strcmp(value, "solar") == 0) opts->scenario = SCENARIO_SOLAR;
+            else if (strcmp(value, "random") == 0) opts->scenario = SCENARIO_RANDOM;
+            else if (strcmp(value, "belt") == 0) opts->scenario = SCENARIO_BELT;
+            else goto bad_value;
+        } else if (strcmp(arg, "--bodies") == 0) {
+            opts->bodies = (size_t)strtoull(value, NULL, 10);
+        } else if (strcmp(arg, "--steps") == 0) {
+            opts->steps = strtol(value, NULL, 10);
+        } else if (strcmp(arg, "--dt") == 0) {
+            opts->dt = strtod(value, NULL);
+        } else if (strcmp(arg, "--solver") == 0) {
+            if (strcmp(value, "direct") == 0) opts->solver = SIM_SOLVER_DIRECT;
+            else if (strcmp(value, "barnes-hut") == 0) opts->solver = SIM_SOLVER_BARNES_HUT;
+            else goto bad_value;
+        } else if (strcmp(arg, "--theta") == 0) {
+            opts->theta = strtod(value, NULL);
+        } else if (strcmp(arg, "--integrator") == 0) {
+            if (strcmp(value, "verlet") == 0) opts->integrator = SIM_INTEGRATOR_VERLET;
+            else if (strcmp(value, "wh") == 0) opts->integrator = SIM_INTEGRATOR_WISDOM_HOLMAN;
+            else goto bad_value;
+        } else if (strcmp(arg, "--threads") == 0) {
+            opts->threads = atoi(value);
+        } else if (strcmp(arg, "--kernel") == 0) {
+            GravityKernel kernel;
+            if (strcmp(value, "scalar") == 0) kernel = GRAVITY_KERNEL_SCALAR;
+            else if (strcmp(value, "avx2") == 0) kernel = GRAVITY_KERNEL_AVX2;
+            else if (strcmp(value, "avx512") == 0) kernel = GRAVITY_KERNEL_AVX512;
+            else goto bad_value;
+            if (!gravity_set_kernel(kernel)) {
+                fprintf(stderr, "kernel %s is not supported on this CPU\n", value);
+                return false;
+            }
+        } else if (strcmp(arg, "--rng-seed") == 0) {
+            opts->rng_seed = strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--check-threads") == 0) {
+            opts->check_threads = atoi(value);
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return false;
+        }
+        continue;
+
+    bad_value:
+        fprintf(stderr, "bad value '%s' for %s\n", value, arg);
+        return false;
+    }
+
+    if (opts->steps < 0 || opts->dt <= 0.0) {
+        fprintf(stderr, "--steps must be >= 0 and --dt > 0\n");
+        return false;
+    }
+    return true;
+}
+
+// Seeds `sim` from a fresh arena. Trails are off: nothing here draws them.
+static bool setup(const Options* opts, int threads, Arena** arena_out, SimContext* sim) {
+    Arena* arena = init_arena(HEADLESS_ARENA_BLOCK);
+    if (!arena) {
+        fprintf(stderr, "could not allocate the arena\n");
+        return false;
+    }
+
+    *sim = (SimContext){0};
+    sim_init_empty(sim, arena);
+    sim->trail_length = 0;
+    sim->solver = opts->solver;
+    sim->bh_theta = opts->theta;
+    sim->integrator = opts->integrator;
+    sim_set_thread_count(sim, threads);
+
+    switch (opts->scenario) {
+    case SCENARIO_SOLAR:
+        sim_seed_solar_system(sim);
+        break;
+    case SCENARIO_RANDOM:
+        sim_seed_random_disk(sim, opts->bodies, 10.0 * AU, opts->rng_seed);
+        break;
+    case SCENARIO_BELT:
+        sim_seed_solar_system(sim);
+        sim_add_particle_ring(sim, sim_body_id(sim, 0), 2.2 * AU, 3.3 * AU, opts->bodies,
+                              (SimColor){150, 140, 120, 255}, opts->rng_seed);
+        break;
+    }
+
+    *arena_out = arena;
+    return true;
+}
+
+// Returns wall-clock seconds spent stepping.
+static double run(const Options* opts, SimContext* sim) {
+    double start = sim_clock_now();
+    for (long i = 0; i < opts->steps; i++) {
+        sim_step(sim, opts->dt);
+    }
+    return sim_clock_now() - start;
+}
+
+static bool same_state(const SimContext* a, const SimContext* b) {
+    const size_t bodies = sim_body_count(a);
+    const size_t particles = sim_particle_count(a);
+    if (bodies != sim_body_count(b) || particles != sim_particle_count(b)) {
+        return false;
+    }
+
+    const Array_double* lhs[] = {&a->bodies.x, &a->bodies.y, &a->bodies.vx, &a->bodies.vy,
+                                 &a->particles.x, &a->particles.y, &a->particles.vx, &a->particles.vy};
+    const Array_double* rhs[] = {&b->bodies.x, &b->bodies.y, &b->bodies.vx, &b->bodies.vy,
+                                 &b->particles.x, &b->particles.y, &b->particles.vx, &b->particles.vy};
+    for (size_t i = 0; i < sizeof(lhs) / sizeof(lhs[0]); i++) {
+        if (lhs[i]->length && memcmp(lhs[i]->data, rhs[i]->data, lhs[i]->length * sizeof(double)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_state(const SimContext* sim, bool dump_particles) {
+    for (size_t i = 0; i < sim_body_count(sim); i++) {
+        PhysicalBody body = sim_get_body(sim, sim_body_id(sim, i));
+        printf("body %zu %s %.17g %.17g %.17g %.17g %.17g\n", i, body.name ? body.name : "-",
+               body.x, body.y, body.vx, body.vy, body.mass);
+    }
+    if (!dump_particles) {
+        return;
+    }
+    const ParticleStore* p = &sim->particles;
+    for (size_t i = 0; i < sim_particle_count(sim); i++) {
+        printf("particle %zu %.17g %.17g %.17g %.17g\n", i,
+               p->x.data[i], p->y.data[i], p->vx.data[i], p->vy.data[i]);
+    }
+}
+
+// Worst |a - a_ref| / (GRAVITY_SIMD_TOLERANCE * sum_j |m_j / r_ij^2|) over
+// both components of every body, 1 being the bound in gravity.h.
+static double kernel_error(const SimContext* sim, const double* ax, const double* ay, const double* ref_x,
+                           const double* ref_y) {
+    const size_t count = sim_body_count(sim);
+    const double* x = sim->bodies.x.data;
+    const double* y = sim->bodies.y.data;
+    const double* mass = sim->bodies.mass.data;
+    double worst = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double scale = 0.0;
+        for (size_t j = 0; j < count; j++) {
+            const double dx = x[j] - x[i];
+            const double dy = y[j] - y[i];
+            const double dist2 = dx * dx + dy * dy;
+            if (dist2 > 0.0) scale += fabs(mass[j] / dist2);
+        }
+        const double bound = GRAVITY_SIMD_TOLERANCE * scale;
+        const double err = fmax(fabs(ax[i] - ref_x[i]), fabs(ay[i] - ref_y[i]));
+        if (bound > 0.0) worst = fmax(worst, err / bound);
+        else if (err > 0.0) worst = INFINITY;
+    }
+    return worst;
+}
+
+// Checks the body field of every supported SIMD kernel, and of the tiled
+// pair loop, against gravity_field_pairwise.
+static bool check_kernels(const SimContext* sim) {
+    const size_t count = sim_body_count(sim);
+    const double* x = sim->bodies.x.data;
+    const double* y = sim->bodies.y.data;
+    const double* mass = sim->bodies.mass.data;
+    Arena* arena = init_arena(HEADLESS_ARENA_BLOCK);
+    double* ref_x = arena ? (double*)arena_alloc(arena, (count + 1) * sizeof(double)) : NULL;
+    double* ref_y = arena ? (double*)arena_alloc(arena, (count + 1) * sizeof(double)) : NULL;
+    double* ax = arena ? (double*)arena_alloc(arena, (count + 1) * sizeof(double)) : NULL;
+    double* ay = arena ? (double*)arena_alloc(arena, (count + 1) * sizeof(double)) : NULL;
+    if (!ref_x || !ref_y || !ax || !ay) {
+        fprintf(stderr, "could not allocate the kernel check buffers\n");
+        free_arena(arena);
+        return false;
+    }
+    gravity_field_pairwise(x, y, mass, count, ref_x, ref_y);
+
+    bool ok = true;
+    const GravityKernel original = gravity_kernel();
+    const GravityKernel simd[] = {GRAVITY_KERNEL_AVX2, GRAVITY_KERNEL_AVX512};
+    for (size_t k = 0; k < sizeof(simd) / sizeof(simd[0]); k++) {
+        if (!gravity_set_kernel(simd[k])) {
+            printf("check_kernel %s unsupported\n", gravity_kernel_name(simd[k]));
+            continue;
+        }
+        gravity_field_tiled(sim->pool, x, y, mass, count, x, y, count, ax, ay);
+        const double worst = kernel_error(sim, ax, ay, ref_x, ref_y);
+        printf("check_kernel %s %s worst %.3g of tolerance\n", gravity_kernel_name(simd[k]),
+               worst <= 1.0 ? "within" : "MISMATCH", worst);
+        ok = ok && worst <= 1.0;
+    }
+    gravity_set_kernel(original);
+
+    gravity_field_pairwise_tiled(sim->pool, x, y, mass, count, ax, ay, arena);
+    const double worst = kernel_error(sim, ax, ay, ref_x, ref_y);
+    printf("check_kernel pair-tiles %s worst %.3g of tolerance\n", worst <= 1.0 ? "within" : "MISMATCH", worst);
+    ok = ok && worst <= 1.0;
+
+    free_arena(arena);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    Options opts = {
+        .scenario = SCENARIO_SOLAR,
+        .bodies = 1000,
+        .steps = 1000,
+        .dt = 3600.0,
+        .solver = SIM_SOLVER_DIRECT,
+        .theta = SIM_DEFAULT_BH_THETA,
+        .integrator = SIM_INTEGRATOR_VERLET,
+        .threads = 1,
+        .check_threads = 0,
+        .check_kernels = false,
+        .rng_seed = 1,
+        .dump_particles = false,
+        .quiet = false,
+    };
+    if (!parse_options(argc, argv, &opts)) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (opts.threads <= 0) {
+        opts.threads = worker_pool_cpu_count();
+    }
+
+    Arena* arena = NULL;
+    SimContext sim;
+    if (!setup(&opts, opts.threads, &arena, &sim)) {
+        return 1;
+    }
+
+    printf("# scenario=%s bodies=%zu particles=%zu steps=%ld dt=%g solver=%s integrator=%s threads=%d kernel=%s\n",
+           scenario_names[opts.scenario], sim_body_count(&sim), sim_particle_count(&sim), opts.steps, opts.dt,
+           opts.solver == SIM_SOLVER_BARNES_HUT ? "barnes-hut" : "direct",
+           opts.integrator == SIM_INTEGRATOR_WISDOM_HOLMAN ? "wh" : "verlet",
+           sim.thread_count, gravity_kernel_name(gravity_kernel()));
+
+    int status = 0;
+    if (opts.check_kernels && !check_kernels(&sim)) {
+        status = 1;
+    }
+
+    double wall = run(&opts, &sim);
+    if (!opts.quiet) {
+        print_state(&sim, opts.dump_particles);
+    }
+    printf("sim_seconds %.17g\n", sim.time_seconds);
+    printf("wall_seconds %.6f\n", wall);
+    printf("steps_per_second %.1f\n", wall > 0.0 ? (double)opts.steps / wall : 0.0);
+    printf("arena_bytes_used %zu\n", arena->used);
+    printf("arena_bytes_peak %zu\n", arena->high_water);
+    printf("arena_failed_allocs %zu\n", arena->failed_allocs);
+
+    if (opts.check_threads > 0) {
+        // Compare a fresh single-threaded run against a fresh run at the requested width.
+        Arena* ref_arena = NULL;
+        Arena* wide_arena = NULL;
+        SimContext ref, wide;
+        if (!setup(&opts, 1, &ref_arena, &ref) || !setup(&opts, opts.check_threads, &wide_arena, &wide)) {
+            return 1;
+        }
+        run(&opts, &ref);
+        run(&opts, &wide);
+        bool identical = same_state(&ref, &wide);
+        printf("check_threads %d %s\n", wide.thread_count, identical ? "identical" : "MISMATCH");
+        status = identical ? status : 1;
+
+        sim_shutdown(&wide);
+        sim_shutdown(&ref);
+        free_arena(wide_arena);
+        free_arena(ref_arena);
+    }
+
+    sim_shutdown(&sim);
+    free_arena(arena);
+    return status;
+}
@@ -0,0 +1,91 @@
+#include "kepler.h"
+
+#include <math.h>
+
+#define KEPLER_MAX_ITERATIONS 50
+#define KEPLER_TOLERANCE 1e-14
+
+// Stumpff functions c2(z) and c3(z), with series near z = 0 where the closed
+// forms cancel catastrophically.
+static void stumpff(double z, double* c2, double* c3) {
+    if (z > 1e-6) {
+        const double sz = sqrt(z);
+        *c2 = (1.0 - cos(sz)) / z;
+        *c3 = (sz - sin(sz)) / (sz * z);
+    } else if (z < -1e-6) {
+        const double sz = sqrt(-z);
+        *c2 = (1.0 - cosh(sz)) / z;
+        *c3 = (sinh(sz) - sz) / (sz * -z);
+    } else {
+        *c2 = 1.0 / 2.0 - z / 24.0 + z * z / 720.0;
+        *c3 = 1.0 / 6.0 - z / 120.0 + z * z / 5040.0;
+    }
+}
+
+bool kepler_drift(double mu, double dt, double* x, double* y, double* vx, double* vy) {
+    const double r0 = sqrt(*x * *x + *y * *y);
+    if (r0 <= 0.0 || mu <= 0.0) {
+        return false;
+    }
+
+    const double sqrt_mu = sqrt(mu);
+    const double v2 = *vx * *vx + *vy * *vy;
+    const double rv = (*x * *vx + *y * *vy) / sqrt_mu;
+    const double alpha = 2.0 / r0 - v2 / mu;  // 1 / semi-major axis
+
+    // Whole orbits change nothing, and a shorter span keeps Newton well-behaved.
+    if (alpha > 0.0) {
+        const double period = 2.0 * M_PI / (sqrt_mu * alpha * sqrt(alpha));
+        if (fabs(dt) > period) {
+            dt = fmod(dt, period);
+        }
+    }
+
+    double chi = sqrt_mu * dt / r0;
+    double c2 = 0.5, c3 = 1.0 / 6.0;
+    double r = r0;
+    bool converged = false;
+
+    for (int i = 0; i < KEPLER_MAX_ITERATIONS; i++) {
+        const double chi2 = chi * chi;
+        const double z = alpha * chi2;
+        stumpff(z, &c2, &c3);
+
+        const double f = rv * chi2 * c2 + (1.0 - alpha * r0) * chi2 * chi * c3 + r0 * chi - sqrt_mu * dt;
+        r = rv * chi * (1.0 - z * c3) + (1.0 - alpha * r0) * chi2 * c2 + r0;
+        if (r <= 0.0) {
+            break;
+        }
+
+        const double delta = f / r;
+        chi -= delta;
+        if (fabs(delta) <= KEPLER_TOLERANCE * (fabs(chi) + 1e-300)) {
+            const double chi2_new = chi * chi;
+            stumpff(alpha * chi2_new, &c2, &c3);
+            r = rv * chi * (1.0 - alpha * chi2_new * c3) + (1.0 - alpha * r0) * chi2_new * c2 + r0;
+            converged = r > 0.0;
+            break;
+        }
+    }
+
+    if (!converged) {
+        return false;
+    }
+
+    const double chi2 = chi * chi;
+    const double f = 1.0 - chi2 / r0 * c2;
+    const double g = dt - chi2 * chi * c3 / sqrt_mu;
+    const double fdot = sqrt_mu / (r * r0) * chi * (alpha * chi2 * c3 - 1.0);
+    const double gdot = 1.0 - chi2 / r * c2;
+
+    const double new_x = f * *x + g * *vx;
+    const double new_y = f * *y + g * *vy;
+    const double new_vx = fdot * *x + gdot * *vx;
+    const double new_vy = fdot * *y + gdot * *vy;
+
+    *x = new_x;
+    *y = new_y;
+    *vx = new_vx;
+    *vy = new_vy;
+    return true;
+}
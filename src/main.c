@@ -1,5 +1,7 @@
 #include "raylib.h"
 #include "sim.h"
+#include "sim_draw.h"
+#include "sim_clock.h"
 
 #include <stdio.h>
 #include <math.h>
@@ -71,6 +73,28 @@ int waypoint_array_find_near(const Array_Waypoint* list, double x, double y, dou
     return -1;
 }
 
+// Closest body whose drawn disc (at least snap_radius_px) contains the point.
+BodyId body_find_near(const SimContext* sim, double x, double y, double cam_x, double cam_y,
+                      double cam_zoom, int screen_width, int screen_height, double snap_radius_px) {
+    BodyId best = SIM_NO_BODY;
+    double best_dist = 0.0;
+    for (size_t i = 0; i < sim_body_count(sim); i++) {
+        double screen_x = (sim->bodies.x.data[i] - cam_x) * cam_zoom + screen_width / 2.0;
+        double screen_y = (sim->bodies.y.data[i] - cam_y) * cam_zoom + screen_height / 2.0;
+        double radius = fmax(snap_radius_px, sim->bodies.meta.data[i].radius * cam_zoom);
+
+        double dx = screen_x - x;
+        double dy = screen_y - y;
+        double dist = sqrt(dx * dx + dy * dy);
+
+        if (dist <= radius && (best == SIM_NO_BODY || dist < best_dist)) {
+            best = sim_body_id(sim, i);
+            best_dist = dist;
+        }
+    }
+    return best;
+}
+
 void waypoint_array_remove(Array_Waypoint* list, size_t index) {
     if (index >= list->length) return;
     if (index + 1 < list->length) {
@@ -244,6 +268,12 @@ int main(void) {
     double time_scale = 3600.0;
     const double min_time_scale = 1.0;
     const double max_time_scale = 86400.0 * 365.0;
+    // Keeps Phobos (7.6 h period) well resolved even at the top speed.
+    const double max_substep = 600.0;
+    // Steps per real second, independent of the frame rate: frames are drawn
+    // between the last two steps, so this can go below the display's rate.
+    const double physics_hz = 60.0;
+    const double frame_budget_seconds = 0.010;
 
     InitWindow(screen_width, screen_height, "Fizyka - Gravity Sim");
     SetTargetFPS(60);
@@ -251,12 +281,21 @@ int main(void) {
     Arena* arena = init_arena(10 * 1024 * 1024);
     SimContext sim = {0};
     sim_init(&sim, arena);
+    sim_set_thread_count(&sim, worker_pool_cpu_count());
+    const BodyId sun_id = sim_body_id(&sim, 0);
+    SimTextCache label_widths;
+    sim_text_cache_init(&label_widths, sim_draw_measure_text, NULL, arena);
 
     double cam_x = 0.0;
     double cam_y = 0.0;
     double cam_zoom = 3.0e-9;
 
     bool paused = false;
+    bool density_mode = false;
+    SimSplatTexture density_texture = {0};
+
+    SimClock clock;
+    sim_clock_init(&clock, fmin(max_substep, time_scale / physics_hz), frame_budget_seconds);
     
     Timer timer = {0};
     Array_Waypoint waypoints;
@@ -268,6 +307,8 @@ int main(void) {
     int selected_waypoint = -1;
 
     while (!WindowShouldClose()) {
+        sim_begin_frame(&sim);
+
         const float wheel = GetMouseWheelMove();
         if (wheel != 0.0f) {
             cam_zoom *= (1.0 + wheel * 0.15);
@@ -301,6 +342,12 @@ int main(void) {
             }
         }
 
+        if (IsKeyPressed(KEY_X)) {
+            Vector2 mouse_pos = GetMousePosition();
+            sim_remove_body(&sim, body_find_near(&sim, mouse_pos.x, mouse_pos.y, cam_x, cam_y, cam_zoom,
+                                                 screen_width, screen_height, 10.0));
+        }
+
         if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
             Vector2 mouse_pos = GetMousePosition();
             int near_idx = waypoint_array_find_near(&waypoints, mouse_pos.x, mouse_pos.y,
@@ -341,6 +388,7 @@ int main(void) {
             if (time_scale > max_time_scale) {
                 time_scale = max_time_scale;
             }
+            clock.fixed_dt = fmin(max_substep, time_scale / physics_hz);
         }
 
         if (IsKeyPressed(KEY_MINUS) || IsKeyPressed(KEY_KP_SUBTRACT)) {
@@ -348,6 +396,27 @@ int main(void) {
             if (time_scale < min_time_scale) {
                 time_scale = min_time_scale;
             }
+            clock.fixed_dt = fmin(max_substep, time_scale / physics_hz);
+        }
+
+        if (IsKeyPressed(KEY_B)) {
+            sim.solver = sim.solver == SIM_SOLVER_DIRECT ? SIM_SOLVER_BARNES_HUT : SIM_SOLVER_DIRECT;
+        }
+
+        if (IsKeyPressed(KEY_I)) {
+            sim.integrator = sim.integrator == SIM_INTEGRATOR_VERLET ? SIM_INTEGRATOR_WISDOM_HOLMAN
+                                                                    : SIM_INTEGRATOR_VERLET;
+        }
+
+        if (IsKeyPressed(KEY_P)) {
+            // Main asteroid belt as massless test particles around the Sun.
+            const double AU = 1.496e11;
+            sim_add_particle_ring(&sim, sun_id, 2.2 * AU, 3.3 * AU, 10000,
+                                  (SimColor){150, 140, 120, 255}, (unsigned long)sim_particle_count(&sim));
+        }
+
+        if (IsKeyPressed(KEY_D)) {
+            density_mode = !density_mode;
         }
 
         if (IsKeyPressed(KEY_T)) {
@@ -361,11 +430,9 @@ int main(void) {
         double sim_dt = 0.0;
         
         if (!paused) {
-            sim_dt = time_scale * GetFrameTime();
-            sim_step(&sim, sim_dt);
+            sim_dt = sim_clock_advance(&clock, &sim, time_scale * GetFrameTime());
         } else if (step_once) {
-            sim_dt = time_scale;
-            sim_step(&sim, sim_dt);
+            sim_dt = sim_clock_advance(&clock, &sim, time_scale);
         }
 
         timer_update(&timer, sim_dt);
@@ -373,7 +440,12 @@ int main(void) {
         BeginDrawing();
         ClearBackground((Color){10, 12, 20, 255});
 
-        sim_draw(&sim, cam_x, cam_y, cam_zoom, screen_width, screen_height);
+        const double blend = sim_clock_blend(&clock);
+        if (density_mode) {
+            sim_draw_splat(&sim, &density_texture, cam_x, cam_y, cam_zoom, screen_width, screen_height, blend);
+        } else {
+            sim_draw(&sim, &label_widths, cam_x, cam_y, cam_zoom, screen_width, screen_height, blend);
+        }
         
         waypoint_line_array_draw(&waypoint_lines, &waypoints, cam_x, cam_y, cam_zoom, screen_width, screen_height);
         waypoint_array_draw(&waypoints, cam_x, cam_y, cam_zoom, screen_width, screen_height);
@@ -388,7 +460,7 @@ int main(void) {
         int panel_x = 12;
         int panel_y = 12;
         int panel_width = 380;
-        int panel_height = 220;
+        int panel_height = 240;
         
         DrawRectangle(panel_x, panel_y, panel_width, panel_height, (Color){15, 18, 30, 230});
         DrawRectangleLines(panel_x, panel_y, panel_width, panel_height, (Color){90, 100, 120, 255});
@@ -397,13 +469,24 @@ int main(void) {
         int text_y = panel_y + 12;
         int line_height = 20;
         
-        DrawText(TextFormat("Bodies: %zu", sim.bodies.length), text_x, text_y, 16, RAYWHITE);
+        DrawText(TextFormat("Bodies: %zu  Particles: %zu", sim_body_count(&sim), sim_particle_count(&sim)), text_x, text_y, 16, RAYWHITE);
         text_y += line_height;
         
         DrawText(TextFormat("Time: %.2f days", sim.time_seconds / 86400.0), text_x, text_y, 16, RAYWHITE);
         text_y += line_height;
         
         DrawText(TextFormat("Speed: %.0fx", time_scale), text_x, text_y, 16, RAYWHITE);
+        DrawText(TextFormat("%d x %.0fs", clock.steps_last_frame, clock.fixed_dt), text_x + 180, text_y, 16,
+                 clock.behind ? ORANGE : RAYWHITE);
+        if (clock.behind) {
+            DrawText("BEHIND", text_x + 290, text_y, 16, ORANGE);
+        }
+        text_y += line_height;
+
+        const char *solver_name = sim.solver == SIM_SOLVER_BARNES_HUT ? "Barnes-Hut" : "Direct";
+        const char *integrator_name = sim.integrator == SIM_INTEGRATOR_WISDOM_HOLMAN ? "WH" : "Verlet";
+        DrawText(TextFormat("Solver: %s (theta %.2f)  %s", solver_name, sim.bh_theta, integrator_name),
+                 text_x, text_y, 16, RAYWHITE);
         text_y += line_height;
         
         const char *timer_status = timer.running ? "RUNNING" : "PAUSED";
@@ -420,16 +503,16 @@ int main(void) {
                    1.0f, (Color){60, 70, 90, 255});
         text_y += 10;
 
-        DrawText("SPACE: pause  N: step  +/-: speed", text_x, text_y, 13, LIGHTGRAY);
+        DrawText("SPACE: pause  N: step  +/-: speed  X: delete body", text_x, text_y, 13, LIGHTGRAY);
         text_y += 16;
         
         DrawText("Mouse wheel: zoom  Middle drag: pan", text_x, text_y, 13, LIGHTGRAY);
         text_y += 16;
         
-        DrawText("T: toggle timer  R: reset timer", text_x, text_y, 13, LIGHTGRAY);
+        DrawText("T: toggle timer  R: reset timer  B: solver  I: integrator", text_x, text_y, 13, LIGHTGRAY);
         text_y += 16;
         
-        DrawText("W: place waypoint  E: remove waypoint", text_x, text_y, 13, LIGHTGRAY);
+        DrawText("W: place waypoint  E: remove waypoint  P: add belt  D: density", text_x, text_y, 13, LIGHTGRAY);
         text_y += 16;
         
         DrawText("Left click: draw line  Right click: delete line", text_x, text_y, 13, LIGHTGRAY);
@@ -437,7 +520,9 @@ int main(void) {
         EndDrawing();
     }
 
+    sim_splat_texture_unload(&density_texture);
     CloseWindow();
+    sim_shutdown(&sim);
     free_arena(arena);
     return 0;
 }
\ No newline at end of file
@@ -1,15 +1,19 @@
 #include "sim.h"
+#include "barnes_hut.h"
+#include "gravity.h"
+#include "kepler.h"
 
 #include <math.h>
 #include <string.h>
 
 #define G 6.67430e-11
 #define TRAIL_LENGTH 2000
-#define TRAIL_RECORD_INTERVAL 5
-
-typedef struct {
-    double ax, ay;
-} BodyAccel;
+// Most trail samples one step may record; a longer step spreads this many
+// evenly instead of recording every interval it crossed.
+#define TRAIL_MAX_SAMPLES_PER_STEP 4
+#define SIM_NO_SLOT UINT32_MAX
+// Generations stay below 2^31 so handles are never negative.
+#define SIM_GENERATION_MASK 0x7FFFFFFFu
 
 typedef struct {
     double semi_major_axis;  // meters
@@ -34,7 +38,7 @@ static PhysicalBody create_circular_orbit(
     double initial_angle,
     double mass,
     float radius,
-    Color color,
+    SimColor color,
     const char* name)
 {
     double vel = circular_orbital_velocity(parent->mass, orbit_radius);
@@ -64,7 +68,7 @@ static PhysicalBody create_elliptical_orbit(
     double initial_angle,  // radians (0 = periapsis)
     double mass,
     float radius,
-    Color color,
+    SimColor color,
     const char* name)
 {
     double semi_major_axis = (periapsis + apoapsis) / 2.0;
@@ -104,7 +108,7 @@ static PhysicalBody create_from_orbital_elements(
     const OrbitalElements* elements,
     double mass,
     float radius,
-    Color color,
+    SimColor color,
     const char* name)
 {
     double periapsis = elements->semi_major_axis * (1.0 - elements->eccentricity);
@@ -114,26 +118,107 @@ static PhysicalBody create_from_orbital_elements(
                                    elements->longitude, mass, radius, color, name);
 }
 
-static void trail_init(TrailBuffer* trail, Arena* arena) {
-    trail->points = (TrailPoint*)arena_alloc(arena, TRAIL_LENGTH * sizeof(TrailPoint));
-    trail->capacity = trail->points ? TRAIL_LENGTH : 0;
+static size_t trail_capacity_for(size_t length) {
+    return (length + SIM_TRAIL_CHUNK_POINTS - 1) / SIM_TRAIL_CHUNK_POINTS * SIM_TRAIL_CHUNK_POINTS;
+}
+
+static void trail_init(TrailBuffer* trail, size_t length, Arena* arena) {
+    const size_t capacity = trail_capacity_for(length);
+    const size_t chunk_count = capacity / SIM_TRAIL_CHUNK_POINTS;
+    // Through arena_realloc, so chunks handed back by sim_add_body are reused.
+    trail->chunks = capacity > 0 ? (TrailChunk*)arena_realloc(arena, NULL, 0, chunk_count * sizeof(TrailChunk),
+                                                              ARENA_SIMD_ALIGNMENT)
+                                 : NULL;
+    trail->capacity = trail->chunks ? capacity : 0;
     trail->head = 0;
     trail->count = 0;
 }
 
-static void trail_add_point(TrailBuffer* trail, double x, double y) {
-    if (!trail->points || trail->capacity == 0) {
-        return;
+static TrailPoint trail_get(const TrailBuffer* trail, size_t index) {
+    const TrailChunk* chunk = &trail->chunks[index / SIM_TRAIL_CHUNK_POINTS];
+    const size_t lane = index % SIM_TRAIL_CHUNK_POINTS;
+    return (TrailPoint){chunk->anchor_x + chunk->dx[lane], chunk->anchor_y + chunk->dy[lane]};
+}
+
+// Writing a chunk's first point re-anchors it and restarts its bounds.
+static void trail_set(TrailBuffer* trail, size_t index, double x, double y) {
+    TrailChunk* chunk = &trail->chunks[index / SIM_TRAIL_CHUNK_POINTS];
+    const size_t lane = index % SIM_TRAIL_CHUNK_POINTS;
+    if (lane == 0) {
+        chunk->anchor_x = x;
+        chunk->anchor_y = y;
+        chunk->min_dx = chunk->min_dy = chunk->max_dx = chunk->max_dy = 0.0f;
     }
-    trail->points[trail->head].x = x;
-    trail->points[trail->head].y = y;
+    const float dx = (float)(x - chunk->anchor_x);
+    const float dy = (float)(y - chunk->anchor_y);
+    chunk->dx[lane] = dx;
+    chunk->dy[lane] = dy;
+    if (dx < chunk->min_dx) chunk->min_dx = dx;
+    if (dx > chunk->max_dx) chunk->max_dx = dx;
+    if (dy < chunk->min_dy) chunk->min_dy = dy;
+    if (dy > chunk->max_dy) chunk->max_dy = dy;
+}
+
+TrailPoint sim_trail_point(const TrailBuffer* trail, size_t i) {
+    return trail_get(trail, (trail->head + trail->capacity - trail->count + i) % trail->capacity);
+}
+
+static void trail_push(TrailBuffer* trail, double x, double y) {
+    // The rest of the chunk about to be re-anchored would no longer decode.
+    if (trail->head % SIM_TRAIL_CHUNK_POINTS == 0 && trail->count > trail->capacity - SIM_TRAIL_CHUNK_POINTS) {
+        trail->count = trail->capacity - SIM_TRAIL_CHUNK_POINTS;
+    }
+    trail_set(trail, trail->head, x, y);
+    trail->last_x = x;
+    trail->last_y = y;
     trail->head = (trail->head + 1) % trail->capacity;
     if (trail->count < trail->capacity) {
         trail->count++;
     }
 }
 
-static void sim_seed_solar_system(SimContext* sim) {
+static void trail_add_point(TrailBuffer* trail, double x, double y, double tolerance) {
+    if (trail->capacity == 0) {
+        return;
+    }
+    if (trail->count == 0) {
+        trail_push(trail, x, y);
+        return;
+    }
+
+    const size_t last = (trail->head + trail->capacity - 1) % trail->capacity;
+    // The newest point's exact position keeps rounding out of the heading sum.
+    const TrailPoint b = {trail->last_x, trail->last_y};
+    if (x == b.x && y == b.y) {
+        return;
+    }
+    const double heading = atan2(y - b.y, x - b.x);
+
+    if (trail->count >= 2 && tolerance > 0.0) {
+        double bend = fabs(heading - trail->heading);
+        if (bend > M_PI) {
+            bend = 2.0 * M_PI - bend;
+        }
+        const TrailPoint a = trail_get(trail, (last + trail->capacity - 1) % trail->capacity);
+        const double cx = x - a.x, cy = y - a.y;
+        const double cross = cx * (b.y - a.y) - cy * (b.x - a.x);
+        const double chord_sq = cx * cx + cy * cy;
+        if (trail->turn + bend < 8.0 * tolerance && fabs(cross) <= tolerance * chord_sq) {
+            trail_set(trail, last, x, y);
+            trail->last_x = x;
+            trail->last_y = y;
+            trail->turn += bend;
+            trail->heading = heading;
+            return;
+        }
+    }
+
+    trail_push(trail, x, y);
+    trail->turn = 0.0;
+    trail->heading = heading;
+}
+
+void sim_seed_solar_system(SimContext* sim) {
  const double AU = 1.496e11;
 
 
@@ -143,7 +228,7 @@ PhysicalBody sun = {
 .vx = 0.0, .vy = 0.0,
 .mass = 1.9885e30,
 .radius = 6.9634e8f,
-.color = YELLOW,
+.color = (SimColor){253,249,0,255},
 .name = "Sun"
 };
 BodyId sun_id = sim_add_body(sim, sun);
@@ -155,49 +240,49 @@ BodyId sun_id = sim_add_body(sim, sun);
 // Mercury (high eccentricity)
 BodyId mercury = sim_add_body_elliptical_orbit(sim, sun_id,
 0.3075*AU, 0.4667*AU, 0.0,
-3.3011e23, 2.4397e6f, (Color){169,169,169,255}, "Mercury");
+3.3011e23, 2.4397e6f, (SimColor){169,169,169,255}, "Mercury");
 
 
 // Venus
 BodyId venus = sim_add_body_elliptical_orbit(sim, sun_id,
 0.7184*AU, 0.7282*AU, 0.0,
-4.8675e24, 6.0518e6f, ORANGE, "Venus");
+4.8675e24, 6.0518e6f, (SimColor){255,161,0,255}, "Venus");
 
 
 // Earth
 BodyId earth = sim_add_body_elliptical_orbit(sim, sun_id,
 0.9833*AU, 1.0167*AU, 0.0,
-5.97237e24, 6.371e6f, BLUE, "Earth");
+5.97237e24, 6.371e6f, (SimColor){0,121,241,255}, "Earth");
 
 
 // Mars
 BodyId mars = sim_add_body_elliptical_orbit(sim, sun_id,
 1.3814*AU, 1.6660*AU, 0.0,
-6.4171e23, 3.3895e6f, RED, "Mars");
+6.4171e23, 3.3895e6f, (SimColor){230,41,55,255}, "Mars");
 
 
 // Jupiter
 BodyId jupiter = sim_add_body_elliptical_orbit(sim, sun_id,
 4.9501*AU, 5.4588*AU, 0.0,
-1.8982e27, 6.9911e7f, (Color){194,178,128,255}, "Jupiter");
+1.8982e27, 6.9911e7f, (SimColor){194,178,128,255}, "Jupiter");
 
 
 // Saturn
 BodyId saturn = sim_add_body_elliptical_orbit(sim, sun_id,
 9.0240*AU, 10.1238*AU, 0.0,
-5.6834e26, 5.8232e7f, (Color){238,214,175,255}, "Saturn");
+5.6834e26, 5.8232e7f, (SimColor){238,214,175,255}, "Saturn");
 
 
 // Uranus
 BodyId uranus = sim_add_body_elliptical_orbit(sim, sun_id,
 18.286*AU, 20.096*AU, 0.0,
-8.6810e25, 2.5362e7f, (Color){79,208,231,255}, "Uranus");
+8.6810e25, 2.5362e7f, (SimColor){79,208,231,255}, "Uranus");
 
 
 // Neptune
 BodyId neptune = sim_add_body_elliptical_orbit(sim, sun_id,
 29.81*AU, 30.33*AU, 0.0,
-1.02413e26, 2.4622e7f, (Color){63,84,186,255}, "Neptune");
+1.02413e26, 2.4622e7f, (SimColor){63,84,186,255}, "Neptune");
 
 
 // ================= MOON SYSTEMS =================
@@ -206,326 +291,1052 @@ BodyId neptune = sim_add_body_elliptical_orbit(sim, sun_id,
 // Earth
 sim_add_body_elliptical_orbit(sim, earth,
 3.633e8, 4.055e8, 0.0,
-7.342e22, 1.737e6f, LIGHTGRAY, "Moon");
+7.342e22, 1.737e6f, (SimColor){200,200,200,255}, "Moon");
 
 
 // Mars
 sim_add_body_elliptical_orbit(sim, mars,
 9.234e6, 9.517e6, 0.0,
-1.0659e16, 1.1267e4f, (Color){120,120,120,255}, "Phobos");
+1.0659e16, 1.1267e4f, (SimColor){120,120,120,255}, "Phobos");
 
 
 sim_add_body_elliptical_orbit(sim, mars,
 2.340e7, 2.346e7, 0.0,
-1.4762e15, 6.2e3f, (Color){160,160,160,255}, "Deimos");
+1.4762e15, 6.2e3f, (SimColor){160,160,160,255}, "Deimos");
 
 
 // Jupiter (Galilean moons)
 sim_add_body_elliptical_orbit(sim, jupiter,
 4.201e8, 4.233e8, 0.0,
-8.9319e22, 1.8216e6f, (Color){255,255,150,255}, "Io");
+8.9319e22, 1.8216e6f, (SimColor){255,255,150,255}, "Io");
 
 
 sim_add_body_elliptical_orbit(sim, jupiter,
 6.644e8, 6.778e8, 0.0,
-4.7998e22, 1.5608e6f, (Color){200,200,180,255}, "Europa");
+4.7998e22, 1.5608e6f, (SimColor){200,200,180,255}, "Europa");
 
 
 sim_add_body_elliptical_orbit(sim, jupiter,
 1.069e9, 1.072e9, 0.0,
-1.4819e23, 2.6341e6f, (Color){150,150,150,255}, "Ganymede");
+1.4819e23, 2.6341e6f, (SimColor){150,150,150,255}, "Ganymede");
 
 
 sim_add_body_elliptical_orbit(sim, jupiter,
 1.882e9, 1.884e9, 0.0,
-1.0759e23, 2.4103e6f, (Color){120,120,120,255}, "Callisto");
+1.0759e23, 2.4103e6f, (SimColor){120,120,120,255}, "Callisto");
 
 
 // Saturn
 sim_add_body_elliptical_orbit(sim, saturn,
 1.186e9, 1.258e9, 0.0,
-1.3452e23, 2.5747e6f, (Color){255,200,150,255}, "Titan");
+1.3452e23, 2.5747e6f, (SimColor){255,200,150,255}, "Titan");
 
 
 sim_add_body_elliptical_orbit(sim, saturn,
 2.379e8, 2.381e8, 0.0,
-1.0802e20, 2.52e5f, (Color){255,255,255,255}, "Enceladus");
+1.0802e20, 2.52e5f, (SimColor){255,255,255,255}, "Enceladus");
 
 
 // Uranus
 sim_add_body_elliptical_orbit(sim, uranus,
 4.356e8, 4.360e8, 0.0,
-3.527e21, 7.88e5f, (Color){200,200,200,255}, "Titania");
+3.527e21, 7.88e5f, (SimColor){200,200,200,255}, "Titania");
 
 
 // Neptune
 sim_add_body_elliptical_orbit(sim, neptune,
 3.548e8, 3.548e8, 0.0,
-2.14e22, 1.353e6f, (Color){220,220,220,255}, "Triton");
+2.14e22, 1.353e6f, (SimColor){220,220,220,255}, "Triton");
 }
 
-void sim_init(SimContext* sim, Arena* arena) {
+static void body_store_init(BodyStore* store, size_t capacity, Arena* arena) {
+    array_init(&store->x, capacity, arena);
+    array_init(&store->y, capacity, arena);
+    array_init(&store->vx, capacity, arena);
+    array_init(&store->vy, capacity, arena);
+    array_init(&store->mass, capacity, arena);
+    array_init(&store->meta, capacity, arena);
+}
+
+static void body_store_clear(BodyStore* store) {
+    array_clear(&store->x);
+    array_clear(&store->y);
+    array_clear(&store->vx);
+    array_clear(&store->vy);
+    array_clear(&store->mass);
+    array_clear(&store->meta);
+}
+
+static void body_store_truncate(BodyStore* store, size_t length) {
+    store->x.length = length;
+    store->y.length = length;
+    store->vx.length = length;
+    store->vy.length = length;
+    store->mass.length = length;
+    store->meta.length = length;
+}
+
+// Returns ARRAY_NO_INDEX, leaving the store as it was, if any array failed to grow.
+static size_t body_store_push(BodyStore* store, const PhysicalBody* body, Arena* arena) {
+    const size_t length = store->x.length;
+    BodyMeta meta = {
+        .radius = body->radius,
+        .color = body->color,
+        .name = body->name,
+    };
+    if (array_push(&store->x, body->x, arena) == ARRAY_NO_INDEX ||
+        array_push(&store->y, body->y, arena) == ARRAY_NO_INDEX ||
+        array_push(&store->vx, body->vx, arena) == ARRAY_NO_INDEX ||
+        array_push(&store->vy, body->vy, arena) == ARRAY_NO_INDEX ||
+        array_push(&store->mass, body->mass, arena) == ARRAY_NO_INDEX ||
+        array_push(&store->meta, meta, arena) == ARRAY_NO_INDEX) {
+        body_store_truncate(store, length);
+        return ARRAY_NO_INDEX;
+    }
+    return length;
+}
+
+static void particle_store_init(ParticleStore* store, size_t capacity, Arena* arena) {
+    array_init(&store->x, capacity, arena);
+    array_init(&store->y, capacity, arena);
+    array_init(&store->vx, capacity, arena);
+    array_init(&store->vy, capacity, arena);
+    array_init(&store->color, capacity, arena);
+}
+
+static void particle_store_clear(ParticleStore* store) {
+    array_clear(&store->x);
+    array_clear(&store->y);
+    array_clear(&store->vx);
+    array_clear(&store->vy);
+    array_clear(&store->color);
+}
+
+// xorshift64*, enough for scattering seed particles reproducibly.
+static double rng_uniform(unsigned long long* state) {
+    unsigned long long v = *state;
+    v ^= v >> 12;
+    v ^= v << 25;
+    v ^= v >> 27;
+    *state = v;
+    return (double)((v * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void sim_seed_random_disk(SimContext* sim, size_t count, double radius, unsigned long rng_seed) {
+    const double body_mass = 1.0e24;
+    const double total_mass = body_mass * (double)count;
+    unsigned long long rng = (unsigned long long)rng_seed * 0x9E3779B97F4A7C15ULL + 1;
+    sim_reserve(sim, sim_body_count(sim) + count, sim_particle_count(sim));
+
+    for (size_t i = 0; i < count; i++) {
+        // sqrt keeps the surface density uniform.
+        double r = radius * sqrt(rng_uniform(&rng));
+        double angle = 2.0 * M_PI * rng_uniform(&rng);
+        double enclosed = total_mass * (r * r) / (radius * radius);
+        double v = r > 0.0 ? sqrt(G * enclosed / r) : 0.0;
+        unsigned char shade = (unsigned char)(120 + 120 * rng_uniform(&rng));
+
+        PhysicalBody body = {
+            .x = r * cos(angle),
+            .y = r * sin(angle),
+            .vx = -v * sin(angle),
+            .vy = v * cos(angle),
+            .mass = body_mass * (0.5 + rng_uniform(&rng)),
+            .radius = 1.0e6f,
+            .color = (SimColor){shade, shade, 255, 255},
+            .name = NULL,
+        };
+        sim_add_body(sim, body);
+    }
+}
+
+// Makes sure every worker has its arena: one per pool thread, or only the
+// calling thread's without a pool. Called on the way into the physics rather
+// than at init. Arenas are never handed back, so shrinking the pool keeps the
+// extra ones for later.
+static void sim_reserve_worker_arenas(SimContext* sim) {
+    const size_t count = sim->pool ? (size_t)sim->thread_count : 1;
+    Array_ArenaPtr* arenas = &sim->worker_arenas;
+    if (count <= arenas->length || !array_reserve(arenas, count, sim->sim_arena)) {
+        return;
+    }
+    while (arenas->length < count) {
+        arenas->data[arenas->length++] = init_arena(SIM_WORKER_ARENA_SIZE);
+    }
+}
+
+void sim_init_empty(SimContext* sim, Arena* arena) {
     sim->sim_arena = arena;
-    array_init(&sim->bodies, 32, arena);
+    body_store_init(&sim->bodies, 32, arena);
+    particle_store_init(&sim->particles, 32, arena);
     array_init(&sim->trails, 32, arena);
+    array_init(&sim->body_slots, 32, arena);
+    array_init(&sim->body_slot_of, 32, arena);
+    sim->free_slot = SIM_NO_SLOT;
     sim->time_seconds = 0.0;
-    sim->trail_frame_counter = 0;
+    sim->trail_interval = SIM_DEFAULT_TRAIL_INTERVAL;
+    sim->trail_next_sample = 0.0;
+    sim->trail_tolerance = SIM_DEFAULT_TRAIL_TOLERANCE;
+    sim->trail_length = TRAIL_LENGTH;
+    sim->trail_slots = 0;
+    sim->solver = SIM_SOLVER_DIRECT;
+    sim->bh_theta = SIM_DEFAULT_BH_THETA;
+    sim->thread_count = 1;
+    sim->pool = NULL;
+    sim->accel = (AccelBuffer){0};
+    sim->accel_next = (AccelBuffer){0};
+    sim->accel_valid = false;
+    sim->previous = (PositionBuffer){0};
+    sim->integrator = SIM_INTEGRATOR_VERLET;
+    sim->force_evaluations = 0;
+    gravity_kernel();
+
+    sim->frame_arenas[0] = NULL;
+    sim->frame_arenas[1] = NULL;
+    sim->frame_index = 0;
+    sim->worker_arenas = (Array_ArenaPtr){0};
+}
 
+void sim_init(SimContext* sim, Arena* arena) {
+    sim_init_empty(sim, arena);
     sim_seed_solar_system(sim);
 }
 
+// Clearing keeps the capacity of every array and the trail buffers, which the
+// re-seeded bodies take over, so any number of resets runs in flat memory.
 void sim_reset(SimContext* sim) {
-    array_clear(&sim->bodies);
+    body_store_clear(&sim->bodies);
+    particle_store_clear(&sim->particles);
+    sim->accel_valid = false;
+    sim->previous.valid = false;
     array_clear(&sim->trails);
     sim->time_seconds = 0.0;
-    sim->trail_frame_counter = 0;
+    sim->trail_next_sample = 0.0;
+
+    // Free every slot, lowest on top so re-seeding hands them out in order.
+    // The generation bump retires all handles from before the reset.
+    array_clear(&sim->body_slot_of);
+    sim->free_slot = SIM_NO_SLOT;
+    for (size_t slot = sim->body_slots.length; slot-- > 0;) {
+        BodySlot* s = &sim->body_slots.data[slot];
+        if (s->live) {
+            s->live = false;
+            s->generation = (s->generation + 1) & SIM_GENERATION_MASK;
+        }
+        s->dense = sim->free_slot;
+        sim->free_slot = (uint32_t)slot;
+    }
 
     sim_seed_solar_system(sim);
 }
 
+bool sim_reserve(SimContext* sim, size_t body_count, size_t particle_count) {
+    BodyStore* bodies = &sim->bodies;
+    ParticleStore* particles = &sim->particles;
+    Arena* arena = sim->sim_arena;
+    return array_reserve(&bodies->x, body_count, arena) &&
+           array_reserve(&bodies->y, body_count, arena) &&
+           array_reserve(&bodies->vx, body_count, arena) &&
+           array_reserve(&bodies->vy, body_count, arena) &&
+           array_reserve(&bodies->mass, body_count, arena) &&
+           array_reserve(&bodies->meta, body_count, arena) &&
+           array_reserve(&sim->trails, body_count, arena) &&
+           array_reserve(&sim->body_slots, body_count, arena) &&
+           array_reserve(&sim->body_slot_of, body_count, arena) &&
+           array_reserve(&particles->x, particle_count, arena) &&
+           array_reserve(&particles->y, particle_count, arena) &&
+           array_reserve(&particles->vx, particle_count, arena) &&
+           array_reserve(&particles->vy, particle_count, arena) &&
+           array_reserve(&particles->color, particle_count, arena);
+}
+
+void sim_shutdown(SimContext* sim) {
+    worker_pool_destroy(sim->pool);
+    sim->pool = NULL;
+    sim->thread_count = 1;
+
+    // The scratch arenas are not part of sim_arena, so free_arena on it would
+    // not release them.
+    for (size_t i = 0; i < sim->worker_arenas.length; i++) {
+        free_arena(sim->worker_arenas.data[i]);
+    }
+    sim->worker_arenas.length = 0;
+    for (int i = 0; i < 2; i++) {
+        free_arena(sim->frame_arenas[i]);
+        sim->frame_arenas[i] = NULL;
+    }
+}
+
+void sim_set_thread_count(SimContext* sim, int thread_count) {
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    if (thread_count == sim->thread_count) {
+        return;
+    }
+
+    worker_pool_destroy(sim->pool);
+    sim->pool = thread_count > 1 ? worker_pool_create(thread_count) : NULL;
+    sim->thread_count = worker_pool_thread_count(sim->pool);
+}
+
+void sim_begin_frame(SimContext* sim) {
+    sim->frame_index ^= 1;
+    Arena** frame = &sim->frame_arenas[sim->frame_index];
+    if (*frame) {
+        arena_reset(*frame);
+    } else {
+        *frame = init_arena(SIM_FRAME_ARENA_SIZE);
+    }
+    for (size_t i = 0; i < sim->worker_arenas.length; i++) {
+        if (sim->worker_arenas.data[i]) {
+            arena_reset(sim->worker_arenas.data[i]);
+        }
+    }
+}
+
+Arena* sim_frame_arena(const SimContext* sim) {
+    return sim->frame_arenas[sim->frame_index];
+}
+
+// Falls back to sim_arena if the worker arena could not be made. Physics
+// temporaries rewind what they take, so that stays correct, but a rewind also
+// empties sim_arena's free lists.
+
+Arena* sim_worker_arena(const SimContext* sim, int worker_index) {
+    if (worker_index < 0 || (size_t)worker_index >= sim->worker_arenas.length ||
+        !sim->worker_arenas.data[worker_index]) {
+        return sim->sim_arena;
+    }
+    return sim->worker_arenas.data[worker_index];
+}
+
+void sim_invalidate_accelerations(SimContext* sim) {
+    sim->accel_valid = false;
+    sim->previous.valid = false;
+}
+
+static BodyId body_handle(uint32_t slot, uint32_t generation) {
+    return (BodyId)(((uint64_t)generation << 32) | slot);
+}
+
+// Takes a slot off the free list, or appends one, and points it at `dense`.
+static uint32_t body_slot_acquire(SimContext* sim, size_t dense) {
+    uint32_t slot = sim->free_slot;
+    if (slot != SIM_NO_SLOT) {
+        sim->free_slot = sim->body_slots.data[slot].dense;
+    } else {
+        BodySlot fresh = {.generation = 0};
+        size_t index = array_push(&sim->body_slots, fresh, sim->sim_arena);
+        if (index == ARRAY_NO_INDEX || index >= SIM_NO_SLOT) {
+            return SIM_NO_SLOT;
+        }
+        slot = (uint32_t)index;
+    }
+    sim->body_slots.data[slot].dense = (uint32_t)dense;
+    sim->body_slots.data[slot].live = true;
+    return slot;
+}
+
+static void body_slot_release(SimContext* sim, uint32_t slot) {
+    BodySlot* s = &sim->body_slots.data[slot];
+    s->live = false;
+    s->generation = (s->generation + 1) & SIM_GENERATION_MASK;
+    s->dense = sim->free_slot;
+    sim->free_slot = slot;
+}
+
+long sim_body_index(const SimContext* sim, BodyId id) {
+    if (id < 0) {
+        return -1;
+    }
+    const uint32_t slot = (uint32_t)((uint64_t)id & 0xFFFFFFFFu);
+    const uint32_t generation = (uint32_t)((uint64_t)id >> 32);
+    if (slot >= sim->body_slots.length) {
+        return -1;
+    }
+    const BodySlot* s = &sim->body_slots.data[slot];
+    if (!s->live || s->generation != generation) {
+        return -1;
+    }
+    return (long)s->dense;
+}
+
+BodyId sim_body_id(const SimContext* sim, size_t index) {
+    if (index >= sim_body_count(sim)) {
+        return SIM_NO_BODY;
+    }
+    const uint32_t slot = sim->body_slot_of.data[index];
+    return body_handle(slot, sim->body_slots.data[slot].generation);
+}
+
 BodyId sim_add_body(SimContext* sim, PhysicalBody body) {
-    BodyId id = (BodyId)array_push(&sim->bodies, body, sim->sim_arena);
+    sim->accel_valid = false;
+    sim->previous.valid = false;
+    size_t index = body_store_push(&sim->bodies, &body, sim->sim_arena);
+    if (index == ARRAY_NO_INDEX) {
+        return SIM_NO_BODY;
+    }
+    // Slots left over from before a sim_reset or a removal still own their
+    // buffers; take one over if it has the right length rather than allocating.
     TrailBuffer trail = {0};
-    trail_init(&trail, sim->sim_arena);
-    array_push(&sim->trails, trail, sim->sim_arena);
-    return id;
+    const size_t trail_index = sim->trails.length;
+    if (trail_index < sim->trail_slots && sim->trails.data[trail_index].capacity == trail_capacity_for(sim->trail_length)) {
+        trail = sim->trails.data[trail_index];
+        trail.head = 0;
+        trail.count = 0;
+        trail.turn = 0.0;
+    } else {
+        // A leftover slot of another length is about to be overwritten:
+        // hand its chunks back before allocating new ones.
+        if (trail_index < sim->trail_slots) {
+            TrailBuffer* old = &sim->trails.data[trail_index];
+            arena_free(sim->sim_arena, old->chunks, old->capacity / SIM_TRAIL_CHUNK_POINTS * sizeof(TrailChunk));
+            *old = (TrailBuffer){0};
+        }
+        trail_init(&trail, sim->trail_length, sim->sim_arena);
+    }
+    if (array_push(&sim->trails, trail, sim->sim_arena) == ARRAY_NO_INDEX) {
+        body_store_truncate(&sim->bodies, index);
+        return SIM_NO_BODY;
+    }
+    if (sim->trails.length > sim->trail_slots) {
+        sim->trail_slots = sim->trails.length;
+    }
+
+    uint32_t slot = body_slot_acquire(sim, index);
+    if (slot == SIM_NO_SLOT || array_push(&sim->body_slot_of, slot, sim->sim_arena) == ARRAY_NO_INDEX) {
+        if (slot != SIM_NO_SLOT) {
+            body_slot_release(sim, slot);
+        }
+        body_store_truncate(&sim->bodies, index);
+        sim->trails.length = index;
+        return SIM_NO_BODY;
+    }
+    return body_handle(slot, sim->body_slots.data[slot].generation);
+}
+
+bool sim_remove_body(SimContext* sim, BodyId id) {
+    const long found = sim_body_index(sim, id);
+    if (found < 0) {
+        return false;
+    }
+    const size_t index = (size_t)found;
+    const size_t last = sim_body_count(sim) - 1;
+    BodyStore* store = &sim->bodies;
+
+    body_slot_release(sim, sim->body_slot_of.data[index]);
+    if (index != last) {
+        store->x.data[index] = store->x.data[last];
+        store->y.data[index] = store->y.data[last];
+        store->vx.data[index] = store->vx.data[last];
+        store->vy.data[index] = store->vy.data[last];
+        store->mass.data[index] = store->mass.data[last];
+        store->meta.data[index] = store->meta.data[last];
+
+        const uint32_t moved = sim->body_slot_of.data[last];
+        sim->body_slot_of.data[index] = moved;
+        sim->body_slots.data[moved].dense = (uint32_t)index;
+
+        // Swap rather than overwrite, so the removed body's buffer stays past
+        // the end where the next sim_add_body picks it up.
+        TrailBuffer trail = sim->trails.data[index];
+        sim->trails.data[index] = sim->trails.data[last];
+        sim->trails.data[last] = trail;
+    }
+    body_store_truncate(store, last);
+    sim->body_slot_of.length = last;
+    sim->trails.length = last;
+    sim->accel_valid = false;
+    sim->previous.valid = false;
+    return true;
+}
+
+size_t sim_body_count(const SimContext* sim) {
+    return sim->bodies.x.length;
+}
+
+PhysicalBody sim_get_body(const SimContext* sim, BodyId id) {
+    const long index = sim_body_index(sim, id);
+    if (index < 0) {
+        return (PhysicalBody){0};
+    }
+    const BodyStore* store = &sim->bodies;
+    const BodyMeta* meta = &store->meta.data[index];
+    return (PhysicalBody){
+        .x = store->x.data[index],
+        .y = store->y.data[index],
+        .vx = store->vx.data[index],
+        .vy = store->vy.data[index],
+        .mass = store->mass.data[index],
+        .radius = meta->radius,
+        .color = meta->color,
+        .name = meta->name,
+    };
+}
+
+void sim_set_body(SimContext* sim, BodyId id, PhysicalBody body) {
+    const long index = sim_body_index(sim, id);
+    if (index < 0) {
+        return;
+    }
+    BodyStore* store = &sim->bodies;
+    sim->accel_valid = false;
+    sim->previous.valid = false;
+    store->x.data[index] = body.x;
+    store->y.data[index] = body.y;
+    store->vx.data[index] = body.vx;
+    store->vy.data[index] = body.vy;
+    store->mass.data[index] = body.mass;
+    store->meta.data[index] = (BodyMeta){
+        .radius = body.radius,
+        .color = body.color,
+        .name = body.name,
+    };
+}
+
+size_t sim_particle_count(const SimContext* sim) {
+    return sim->particles.x.length;
+}
+
+size_t sim_add_test_particle(SimContext* sim, double x, double y, double vx, double vy, SimColor color) {
+    ParticleStore* store = &sim->particles;
+    sim->accel_valid = false;
+    sim->previous.valid = false;
+    const size_t length = store->x.length;
+    if (array_push(&store->x, x, sim->sim_arena) == ARRAY_NO_INDEX ||
+        array_push(&store->y, y, sim->sim_arena) == ARRAY_NO_INDEX ||
+        array_push(&store->vx, vx, sim->sim_arena) == ARRAY_NO_INDEX ||
+        array_push(&store->vy, vy, sim->sim_arena) == ARRAY_NO_INDEX ||
+        array_push(&store->color, color, sim->sim_arena) == ARRAY_NO_INDEX) {
+        store->x.length = length;
+        store->y.length = length;
+        store->vx.length = length;
+        store->vy.length = length;
+        store->color.length = length;
+        return ARRAY_NO_INDEX;
+    }
+    return length;
+}
+
+size_t sim_add_particle_ring(SimContext* sim, BodyId parent_id, double inner_radius, double outer_radius,
+                             size_t count, SimColor color, unsigned long rng_seed)
+{
+    if (sim_body_index(sim, parent_id) < 0) {
+        return 0;
+    }
+
+    const PhysicalBody parent = sim_get_body(sim, parent_id);
+    unsigned long long rng = (unsigned long long)rng_seed * 0x9E3779B97F4A7C15ULL + 1;
+    sim_reserve(sim, sim_body_count(sim), sim_particle_count(sim) + count);
+    for (size_t i = 0; i < count; i++) {
+        double orbit_radius = inner_radius + (outer_radius - inner_radius) * rng_uniform(&rng);
+        double angle = 2.0 * M_PI * rng_uniform(&rng);
+        PhysicalBody p = create_circular_orbit(&parent, orbit_radius, angle, 0.0, 0.0f, color, NULL);
+        if (sim_add_test_particle(sim, p.x, p.y, p.vx, p.vy, color) == ARRAY_NO_INDEX) {
+            return i;
+        }
+    }
+    return count;
+}
+
+size_t sim_add_body_ring(SimContext* sim, BodyId parent_id, double inner_radius, double outer_radius,
+                         size_t count, double mass, SimColor color, unsigned long rng_seed)
+{
+    if (sim_body_index(sim, parent_id) < 0) {
+        return 0;
+    }
+
+    const PhysicalBody parent = sim_get_body(sim, parent_id);
+    unsigned long long rng = (unsigned long long)rng_seed * 0x9E3779B97F4A7C15ULL + 1;
+    sim_reserve(sim, sim_body_count(sim) + count, sim_particle_count(sim));
+    for (size_t i = 0; i < count; i++) {
+        double orbit_radius = inner_radius + (outer_radius - inner_radius) * rng_uniform(&rng);
+        double angle = 2.0 * M_PI * rng_uniform(&rng);
+        if (sim_add_body(sim, create_circular_orbit(&parent, orbit_radius, angle, mass, 1.0e3f, color, NULL)) < 0) {
+            return i;
+        }
+    }
+    return count;
 }
 
 BodyId sim_add_body_circular_orbit(SimContext* sim, BodyId parent_id,
                                    double orbit_radius, double initial_angle,
-                                   double mass, float radius, Color color, const char* name)
+                                   double mass, float radius, SimColor color, const char* name)
 {
-    if (parent_id >= sim->bodies.length) {
-        return (BodyId)-1;
+    if (sim_body_index(sim, parent_id) < 0) {
+        return SIM_NO_BODY;
     }
     
-    const PhysicalBody* parent = &sim->bodies.data[parent_id];
-    PhysicalBody body = create_circular_orbit(parent, orbit_radius, initial_angle,
+    const PhysicalBody parent = sim_get_body(sim, parent_id);
+    PhysicalBody body = create_circular_orbit(&parent, orbit_radius, initial_angle,
                                               mass, radius, color, name);
     return sim_add_body(sim, body);
 }
 
 BodyId sim_add_body_elliptical_orbit(SimContext* sim, BodyId parent_id,
                                      double periapsis, double apoapsis, double initial_angle,
-                                     double mass, float radius, Color color, const char* name)
+                                     double mass, float radius, SimColor color, const char* name)
 {
-    if (parent_id >= sim->bodies.length) {
-        return (BodyId)-1;
+    if (sim_body_index(sim, parent_id) < 0) {
+        return SIM_NO_BODY;
     }
     
-    const PhysicalBody* parent = &sim->bodies.data[parent_id];
-    PhysicalBody body = create_elliptical_orbit(parent, periapsis, apoapsis, initial_angle,
+    const PhysicalBody parent = sim_get_body(sim, parent_id);
+    PhysicalBody body = create_elliptical_orbit(&parent, periapsis, apoapsis, initial_angle,
                                                 mass, radius, color, name);
     return sim_add_body(sim, body);
 }
 
-static void compute_accelerations(SimContext* sim, BodyAccel* accels) {
-    const size_t count = sim->bodies.length;
-    
-    for (size_t i = 0; i < count; i++) {
-        accels[i].ax = 0.0;
-        accels[i].ay = 0.0;
-    }
-    
-    for (size_t i = 0; i < count; i += 1) {
-        PhysicalBody* body_i = &sim->bodies.data[i];
-        for (size_t j = i + 1; j < count; j += 1) {
-            PhysicalBody* body_j = &sim->bodies.data[j];
-            const double dx = body_j->x - body_i->x;
-            const double dy = body_j->y - body_i->y;
-            const double dist2 = dx * dx + dy * dy;
-            const double dist = sqrt(dist2);
-            const double inv_dist3 = 1.0 / (dist2 * dist);
-
-            const double accel_i = G * body_j->mass * inv_dist3;
-            const double accel_j = G * body_i->mass * inv_dist3;
-
-            accels[i].ax += accel_i * dx;
-            accels[i].ay += accel_i * dy;
-            accels[j].ax -= accel_j * dx;
-            accels[j].ay -= accel_j * dy;
-        }
+typedef struct {
+    const QuadTree* tree;
+    double theta;
+    const double* tx;
+    const double* ty;
+    size_t count;
+    bool exclude_self;  // targets are the tree's own bodies
+    double* ax;
+    double* ay;
+} BarnesHutJob;
+
+static void barnes_hut_tile_task(void* ctx, size_t tile, int worker_index) {
+    (void)worker_index;
+    const BarnesHutJob* job = (const BarnesHutJob*)ctx;
+    const size_t begin = tile * GRAVITY_TILE_TARGETS;
+    const size_t end = begin + GRAVITY_TILE_TARGETS < job->count ? begin + GRAVITY_TILE_TARGETS : job->count;
+
+    for (size_t i = begin; i < end; i += 1) {
+        double fx, fy;
+        quadtree_field(job->tree, job->tx[i], job->ty[i], job->exclude_self ? (int32_t)i : -1,
+                       job->theta, &fx, &fy);
+        job->ax[i] = fx;
+        job->ay[i] = fy;
     }
 }
 
-void sim_step(SimContext* sim, double dt_seconds) {
-    const size_t count = sim->bodies.length;
-    if (count == 0 || dt_seconds <= 0.0) {
-        return;
-    }
-    
-    size_t arena_start = sim->sim_arena->offset;
-    
-    BodyAccel* accels = (BodyAccel*)arena_alloc(sim->sim_arena, count * sizeof(BodyAccel));
-    BodyAccel* new_accels = (BodyAccel*)arena_alloc(sim->sim_arena, count * sizeof(BodyAccel));
-    
-    if (!accels || !new_accels) {
-        sim->sim_arena->offset = arena_start;
-        return;
+static void barnes_hut_field(SimContext* sim, const QuadTree* tree, const double* tx, const double* ty,
+                             size_t count, bool exclude_self, double* ax, double* ay) {
+    BarnesHutJob job = {
+        .tree = tree,
+        .theta = sim->bh_theta,
+        .tx = tx,
+        .ty = ty,
+        .count = count,
+        .exclude_self = exclude_self,
+        .ax = ax,
+        .ay = ay,
+    };
+    worker_pool_run(sim->pool, (count + GRAVITY_TILE_TARGETS - 1) / GRAVITY_TILE_TARGETS,
+                    barnes_hut_tile_task, &job);
+}
+
+// Fills body accelerations (ax, ay) and test particle accelerations (pax, pay)
+// due to bodies with the given masses.
+static void compute_accelerations(SimContext* sim, const double* mass,
+                                  double* ax, double* ay, double* pax, double* pay) {
+    const size_t count = sim_body_count(sim);
+    const size_t particle_count = sim_particle_count(sim);
+    const double* x = sim->bodies.x.data;
+    const double* y = sim->bodies.y.data;
+    const double* px = sim->particles.x.data;
+    const double* py = sim->particles.y.data;
+
+    sim->force_evaluations++;
+    bool done = false;
+    if (sim->solver == SIM_SOLVER_BARNES_HUT) {
+        Arena* scratch = sim_worker_arena(sim, 0);
+        ArenaMark arena_start = arena_mark(scratch);
+        QuadTree tree;
+        // Falls back to the direct sum if the tree does not fit in the arena.
+        if (quadtree_build(&tree, x, y, mass, count, scratch)) {
+            barnes_hut_field(sim, &tree, x, y, count, true, ax, ay);
+            barnes_hut_field(sim, &tree, px, py, particle_count, false, pax, pay);
+            done = true;
+        }
+        arena_rewind(scratch, arena_start);
     }
 
-    memset(accels, 0, count * sizeof(BodyAccel));
-    memset(new_accels, 0, count * sizeof(BodyAccel));
+    if (!done) {
+        // The scalar kernel keeps the symmetric pair loop, which does half the
+        // pair work, split into pair tiles on the pool.
+        if (gravity_kernel() == GRAVITY_KERNEL_SCALAR) {
+            gravity_field_pairwise_tiled(sim->pool, x, y, mass, count, ax, ay, sim_worker_arena(sim, 0));
+        } else {
+            gravity_field_tiled(sim->pool, x, y, mass, count, x, y, count, ax, ay);
+        }
+        gravity_field_tiled(sim->pool, x, y, mass, count, px, py, particle_count, pax, pay);
+    }
 
-    compute_accelerations(sim, accels);
+    for (size_t i = 0; i < count; i++) {
+        ax[i] *= G;
+        ay[i] *= G;
+    }
+    for (size_t i = 0; i < particle_count; i++) {
+        pax[i] *= G;
+        pay[i] *= G;
+    }
+}
 
+static void drift(double* x, double* y, const double* vx, const double* vy,
+                  const double* ax, const double* ay, size_t count, double dt) {
+    const double half_dt2 = 0.5 * dt * dt;
     for (size_t i = 0; i < count; i += 1) {
-        PhysicalBody* body = &sim->bodies.data[i];
-        body->x += body->vx * dt_seconds + 0.5 * accels[i].ax * dt_seconds * dt_seconds;
-        body->y += body->vy * dt_seconds + 0.5 * accels[i].ay * dt_seconds * dt_seconds;
+        x[i] += vx[i] * dt + ax[i] * half_dt2;
+        y[i] += vy[i] * dt + ay[i] * half_dt2;
     }
+}
 
-    compute_accelerations(sim, new_accels);
-
+static void kick(double* vx, double* vy, const double* ax, const double* ay,
+                 const double* new_ax, const double* new_ay, size_t count, double dt) {
+    const double half_dt = 0.5 * dt;
     for (size_t i = 0; i < count; i += 1) {
-        PhysicalBody* body = &sim->bodies.data[i];
-        body->vx += 0.5 * (accels[i].ax + new_accels[i].ax) * dt_seconds;
-        body->vy += 0.5 * (accels[i].ay + new_accels[i].ay) * dt_seconds;
-    }
-
-    sim->trail_frame_counter++;
-    if (sim->trail_frame_counter >= TRAIL_RECORD_INTERVAL) {
-        const size_t trail_count = sim->trails.length;
-        const size_t min_count = count < trail_count ? count : trail_count;
-        for (size_t i = 0; i < min_count; i++) {
-            const PhysicalBody* body = &sim->bodies.data[i];
-            trail_add_point(&sim->trails.data[i], body->x, body->y);
+        vx[i] += (ax[i] + new_ax[i]) * half_dt;
+        vy[i] += (ay[i] + new_ay[i]) * half_dt;
+    }
+}
+
+static bool accel_buffer_reserve(AccelBuffer* buffer, size_t count, Arena* arena) {
+    if (buffer->ax.capacity < count || buffer->ay.capacity < count) {
+        size_t capacity = buffer->ax.capacity * 2;
+        if (capacity < count) capacity = count;
+        if (!array_reserve(&buffer->ax, capacity, arena) || !array_reserve(&buffer->ay, capacity, arena)) {
+            return false;
         }
-        sim->trail_frame_counter = 0;
     }
+    buffer->ax.length = count;
+    buffer->ay.length = count;
+    return true;
+}
 
-    sim->time_seconds += dt_seconds;
-    
-    sim->sim_arena->offset = arena_start;
+bool sim_keep_previous_positions(SimContext* sim) {
+    const size_t bodies = sim_body_count(sim);
+    const size_t particles = sim_particle_count(sim);
+    PositionBuffer* previous = &sim->previous;
+    previous->valid = false;
+    previous->x.length = 0;
+    previous->y.length = 0;
+    if (!array_grow_for(&previous->x, bodies + particles, sim->sim_arena) ||
+        !array_grow_for(&previous->y, bodies + particles, sim->sim_arena)) {
+        return false;
+    }
+    if (bodies > 0) {
+        memcpy(previous->x.data, sim->bodies.x.data, bodies * sizeof(double));
+        memcpy(previous->y.data, sim->bodies.y.data, bodies * sizeof(double));
+    }
+    if (particles > 0) {
+        memcpy(previous->x.data + bodies, sim->particles.x.data, particles * sizeof(double));
+        memcpy(previous->y.data + bodies, sim->particles.y.data, particles * sizeof(double));
+    }
+    previous->x.length = bodies + particles;
+    previous->y.length = bodies + particles;
+    previous->valid = true;
+    return true;
 }
 
-void sim_draw(const SimContext* sim, double cam_x, double cam_y, double zoom, int screen_w, int screen_h) {
-    const double half_w = screen_w * 0.5;
-    const double half_h = screen_h * 0.5;
-    const int label_font_size = 12;
+static void step_verlet(SimContext* sim, double dt_seconds) {
+    const size_t count = sim_body_count(sim);
+    const size_t particle_count = sim_particle_count(sim);
+    const double* mass = sim->bodies.mass.data;
 
-    const size_t trail_count = sim->trails.length;
-    const size_t body_count = sim->bodies.length;
-    const size_t min_count = trail_count < body_count ? trail_count : body_count;
+    // Bodies first, particles after them in each array.
+    double* ax = sim->accel.ax.data;
+    double* ay = sim->accel.ay.data;
+    double* new_ax = sim->accel_next.ax.data;
+    double* new_ay = sim->accel_next.ay.data;
 
-    for (size_t i = 0; i < min_count; i += 1) {
-        const TrailBuffer* trail = &sim->trails.data[i];
-        const PhysicalBody* body = &sim->bodies.data[i];
+    BodyStore* bodies = &sim->bodies;
+    ParticleStore* particles = &sim->particles;
 
-        if (trail->count < 2 || trail->capacity == 0) continue;
+    if (!sim->accel_valid) {
+        compute_accelerations(sim, mass, ax, ay, ax + count, ay + count);
+    }
 
-        for (size_t j = 0; j < trail->count - 1; j++) {
-            size_t idx = (trail->head + trail->capacity - trail->count + j) % trail->capacity;
-            size_t next_idx = (idx + 1) % trail->capacity;
+    drift(bodies->x.data, bodies->y.data, bodies->vx.data, bodies->vy.data, ax, ay, count, dt_seconds);
+    drift(particles->x.data, particles->y.data, particles->vx.data, particles->vy.data,
+          ax + count, ay + count, particle_count, dt_seconds);
 
-            double x1 = (trail->points[idx].x - cam_x) * zoom + half_w;
-            double y1 = (trail->points[idx].y - cam_y) * zoom + half_h;
-            double x2 = (trail->points[next_idx].x - cam_x) * zoom + half_w;
-            double y2 = (trail->points[next_idx].y - cam_y) * zoom + half_h;
+    compute_accelerations(sim, mass, new_ax, new_ay, new_ax + count, new_ay + count);
 
-            float alpha_ratio = (float)j / (float)trail->count;
-            unsigned char alpha = (unsigned char)(alpha_ratio * 180.0f + 20.0f);
+    kick(bodies->vx.data, bodies->vy.data, ax, ay, new_ax, new_ay, count, dt_seconds);
+    kick(particles->vx.data, particles->vy.data, ax + count, ay + count,
+         new_ax + count, new_ay + count, particle_count, dt_seconds);
 
-            Color trail_color = body->color;
-            trail_color.a = alpha;
+    // The end-of-step accelerations are the next step's starting ones.
+    AccelBuffer done = sim->accel;
+    sim->accel = sim->accel_next;
+    sim->accel_next = done;
+    sim->accel_valid = true;
+    sim->accel_solver = sim->solver;
+    sim->accel_theta = sim->bh_theta;
+}
 
-            DrawLineEx((Vector2){(float)x1, (float)y1},
-                      (Vector2){(float)x2, (float)y2},
-                      1.0f,
-                      trail_color);
-        }
+// Interaction kick of the Wisdom-Holman splitting: every velocity except the
+// central body's gets dt times the pull of the other non-central bodies.
+static void wh_interaction_kick(SimContext* sim, const double* interaction_mass, size_t central, double dt) {
+    const size_t count = sim_body_count(sim);
+    const size_t particle_count = sim_particle_count(sim);
+    double* ax = sim->accel.ax.data;
+    double* ay = sim->accel.ay.data;
+
+    compute_accelerations(sim, interaction_mass, ax, ay, ax + count, ay + count);
+
+    double* vx = sim->bodies.vx.data;
+    double* vy = sim->bodies.vy.data;
+    for (size_t i = 0; i < count; i++) {
+        if (i == central) continue;
+        vx[i] += ax[i] * dt;
+        vy[i] += ay[i] * dt;
     }
 
-    for (size_t i = 0; i < sim->bodies.length; i += 1) {
-        const PhysicalBody* body = &sim->bodies.data[i];
+    double* pvx = sim->particles.vx.data;
+    double* pvy = sim->particles.vy.data;
+    for (size_t i = 0; i < particle_count; i++) {
+        pvx[i] += ax[count + i] * dt;
+        pvy[i] += ay[count + i] * dt;
+    }
+}
 
-        double sx = (body->x - cam_x) * zoom + half_w;
-        double sy = (body->y - cam_y) * zoom + half_h;
-        double sr = (double)body->radius * zoom;
+// Jump step: heliocentric positions move with the total barycentric momentum
+// of the non-central bodies divided by the central mass.
+static void wh_jump(SimContext* sim, size_t central, double dt) {
+    const size_t count = sim_body_count(sim);
+    const size_t particle_count = sim_particle_count(sim);
+    const double* mass = sim->bodies.mass.data;
+    double* x = sim->bodies.x.data;
+    double* y = sim->bodies.y.data;
+    const double* vx = sim->bodies.vx.data;
+    const double* vy = sim->bodies.vy.data;
+
+    double px = 0.0, py = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        if (i == central) continue;
+        px += mass[i] * vx[i];
+        py += mass[i] * vy[i];
+    }
+    const double shift_x = px / mass[central] * dt;
+    const double shift_y = py / mass[central] * dt;
 
-        if (sr < 2.0) sr = 2.0;
+    for (size_t i = 0; i < count; i++) {
+        if (i == central) continue;
+        x[i] += shift_x;
+        y[i] += shift_y;
+    }
+    for (size_t i = 0; i < particle_count; i++) {
+        sim->particles.x.data[i] += shift_x;
+        sim->particles.y.data[i] += shift_y;
+    }
+}
+
+static void wh_kepler_drift(double mu, double dt, double* x, double* y, double* vx, double* vy) {
+    if (!kepler_drift(mu, dt, x, y, vx, vy)) {
+        // Only reached for degenerate states, e.g. sitting on the central body.
+        *x += *vx * dt;
+        *y += *vy * dt;
+    }
+}
 
-        DrawCircle((int)sx, (int)sy, (float)sr, body->color);
+// Wisdom-Holman map in democratic heliocentric coordinates, kick-drift-kick.
+// The most massive body is the central one; everything else drifts on an
+// analytic Kepler orbit around it between interaction kicks.
+static bool step_wisdom_holman(SimContext* sim, double dt) {
+    const size_t count = sim_body_count(sim);
+    const size_t particle_count = sim_particle_count(sim);
+    double* x = sim->bodies.x.data;
+    double* y = sim->bodies.y.data;
+    double* vx = sim->bodies.vx.data;
+    double* vy = sim->bodies.vy.data;
+    const double* mass = sim->bodies.mass.data;
+    double* px = sim->particles.x.data;
+    double* py = sim->particles.y.data;
+    double* pvx = sim->particles.vx.data;
+    double* pvy = sim->particles.vy.data;
+
+    size_t central = 0;
+    double total_mass = 0.0;
+    double cm_x = 0.0, cm_y = 0.0, cm_vx = 0.0, cm_vy = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        if (mass[i] > mass[central]) central = i;
+        total_mass += mass[i];
+        cm_x += mass[i] * x[i];
+        cm_y += mass[i] * y[i];
+        cm_vx += mass[i] * vx[i];
+        cm_vy += mass[i] * vy[i];
+    }
+    const double central_mass = mass[central];
+    if (count < 2 || central_mass <= 0.0) {
+        return false;
+    }
+    cm_x /= total_mass;
+    cm_y /= total_mass;
+    cm_vx /= total_mass;
+    cm_vy /= total_mass;
+
+    Arena* scratch = sim_worker_arena(sim, 0);
+    ArenaMark arena_start = arena_mark(scratch);
+    double* interaction_mass = (double*)arena_alloc(scratch, count * sizeof(double));
+    if (!interaction_mass) {
+        arena_rewind(scratch, arena_start);
+        return false;
+    }
+    memcpy(interaction_mass, mass, count * sizeof(double));
+    interaction_mass[central] = 0.0;
 
+    // Barycentric -> democratic heliocentric.
+    const double x0 = x[central], y0 = y[central];
+    for (size_t i = 0; i < count; i++) {
+        x[i] -= x0;
+        y[i] -= y0;
+        vx[i] -= cm_vx;
+        vy[i] -= cm_vy;
+    }
+    for (size_t i = 0; i < particle_count; i++) {
+        px[i] -= x0;
+        py[i] -= y0;
+        pvx[i] -= cm_vx;
+        pvy[i] -= cm_vy;
     }
 
-    typedef struct {
-        int x;
-        int y;
-        int w;
-        int h;
-        double size_score;
-        const char* name;
-    } LabelCandidate;
+    const double half_dt = 0.5 * dt;
+    const double mu = G * central_mass;
 
-    size_t arena_start = sim->sim_arena->offset;
-    LabelCandidate* candidates = (LabelCandidate*)arena_alloc(sim->sim_arena,
-        sim->bodies.length * sizeof(LabelCandidate));
-    if (!candidates) {
-        sim->sim_arena->offset = arena_start;
-        return;
+    wh_interaction_kick(sim, interaction_mass, central, half_dt);
+    wh_jump(sim, central, half_dt);
+    for (size_t i = 0; i < count; i++) {
+        if (i == central) continue;
+        wh_kepler_drift(mu, dt, &x[i], &y[i], &vx[i], &vy[i]);
+    }
+    for (size_t i = 0; i < particle_count; i++) {
+        wh_kepler_drift(mu, dt, &px[i], &py[i], &pvx[i], &pvy[i]);
     }
+    wh_jump(sim, central, half_dt);
+    wh_interaction_kick(sim, interaction_mass, central, half_dt);
 
-    size_t candidate_count = 0;
-    for (size_t i = 0; i < sim->bodies.length; i += 1) {
-        const PhysicalBody* body = &sim->bodies.data[i];
-        if (!body->name || !body->name[0]) {
-            continue;
-        }
+    // Democratic heliocentric -> barycentric. The barycentre moves uniformly.
+    cm_x += cm_vx * dt;
+    cm_y += cm_vy * dt;
+    double mq_x = 0.0, mq_y = 0.0, mv_x = 0.0, mv_y = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        if (i == central) continue;
+        mq_x += mass[i] * x[i];
+        mq_y += mass[i] * y[i];
+        mv_x += mass[i] * vx[i];
+        mv_y += mass[i] * vy[i];
+    }
+    const double new_x0 = cm_x - mq_x / total_mass;
+    const double new_y0 = cm_y - mq_y / total_mass;
+    for (size_t i = 0; i < count; i++) {
+        if (i == central) continue;
+        x[i] += new_x0;
+        y[i] += new_y0;
+        vx[i] += cm_vx;
+        vy[i] += cm_vy;
+    }
+    x[central] = new_x0;
+    y[central] = new_y0;
+    vx[central] = cm_vx - mv_x / central_mass;
+    vy[central] = cm_vy - mv_y / central_mass;
+    for (size_t i = 0; i < particle_count; i++) {
+        px[i] += new_x0;
+        py[i] += new_y0;
+        pvx[i] += cm_vx;
+        pvy[i] += cm_vy;
+    }
 
-        double sx = (body->x - cam_x) * zoom + half_w;
-        double sy = (body->y - cam_y) * zoom + half_h;
-        double sr = (double)body->radius * zoom;
-        if (sr < 2.0) sr = 2.0;
-
-        int text_w = MeasureText(body->name, label_font_size);
-        int text_h = label_font_size;
-        int tx = (int)(sx + sr + 4.0);
-        int ty = (int)(sy - text_h / 2);
-
-        candidates[candidate_count++] = (LabelCandidate){
-            .x = tx,
-            .y = ty,
-            .w = text_w,
-            .h = text_h,
-            .size_score = sr,
-            .name = body->name,
-        };
+    arena_rewind(scratch, arena_start);
+    // The buffers now hold interaction-only accelerations.
+    sim->accel_valid = false;
+    return true;
+}
+
+// Sizes both acceleration buffers for the current bodies and particles and
+// drops the cached accelerations if they no longer match the state or solver.
+static bool accel_prepare(SimContext* sim) {
+    const size_t total = sim_body_count(sim) + sim_particle_count(sim);
+    if (sim->accel_valid && (sim->accel.ax.length != total ||
+                             sim->accel_solver != sim->solver || sim->accel_theta != sim->bh_theta)) {
+        sim->accel_valid = false;
+    }
+    if (!accel_buffer_reserve(&sim->accel, total, sim->sim_arena) ||
+        !accel_buffer_reserve(&sim->accel_next, total, sim->sim_arena)) {
+        sim->accel_valid = false;
+        return false;
     }
+    return true;
+}
 
-    for (size_t i = 0; i < candidate_count; i++) {
-        for (size_t j = i + 1; j < candidate_count; j++) {
-            if (candidates[j].size_score > candidates[i].size_score) {
-                LabelCandidate tmp = candidates[i];
-                candidates[i] = candidates[j];
-                candidates[j] = tmp;
-            }
+bool sim_compute_accelerations(SimContext* sim) {
+    sim_reserve_worker_arenas(sim);
+    if (!accel_prepare(sim)) {
+        return false;
+    }
+    const size_t count = sim_body_count(sim);
+    double* ax = sim->accel.ax.data;
+    double* ay = sim->accel.ay.data;
+    compute_accelerations(sim, sim->bodies.mass.data, ax, ay, ax + count, ay + count);
+    sim->accel_valid = true;
+    sim->accel_solver = sim->solver;
+    sim->accel_theta = sim->bh_theta;
+    return true;
+}
+
+// Records the trail samples due in (t0, t0 + dt], placing each on the chord
+// between the pre-step positions (x0, y0) and the current ones.
+static void record_trail_samples(SimContext* sim, const double* x0, const double* y0, double t0, double dt) {
+    const double t1 = t0 + dt;
+    const double interval = sim->trail_interval;
+    double due = floor((t1 - sim->trail_next_sample) / interval) + 1.0;
+    int samples = due < TRAIL_MAX_SAMPLES_PER_STEP ? (int)due : TRAIL_MAX_SAMPLES_PER_STEP;
+    const bool spread = due > TRAIL_MAX_SAMPLES_PER_STEP;
+
+    const size_t count = sim_body_count(sim) < sim->trails.length ? sim_body_count(sim) : sim->trails.length;
+    const double* x1 = sim->bodies.x.data;
+    const double* y1 = sim->bodies.y.data;
+
+    for (int k = 0; k < samples; k++) {
+        double f = spread ? (double)(k + 1) / samples : (sim->trail_next_sample + k * interval - t0) / dt;
+        if (f < 0.0) f = 0.0;
+        for (size_t i = 0; i < count; i++) {
+            trail_add_point(&sim->trails.data[i], x0[i] + (x1[i] - x0[i]) * f, y0[i] + (y1[i] - y0[i]) * f,
+                            sim->trail_tolerance);
         }
     }
+    sim->trail_next_sample += due * interval;
+}
 
-    for (size_t i = 0; i < candidate_count; i++) {
-        bool overlaps = false;
-        for (size_t j = 0; j < i; j++) {
-            int ax1 = candidates[i].x;
-            int ay1 = candidates[i].y;
-            int ax2 = ax1 + candidates[i].w;
-            int ay2 = ay1 + candidates[i].h;
+void sim_step(SimContext* sim, double dt_seconds) {
+    const size_t count = sim_body_count(sim);
+    if (count == 0 || dt_seconds <= 0.0) {
+        return;
+    }
 
-            int bx1 = candidates[j].x;
-            int by1 = candidates[j].y;
-            int bx2 = bx1 + candidates[j].w;
-            int by2 = by1 + candidates[j].h;
+    sim_reserve_worker_arenas(sim);
+    if (!accel_prepare(sim)) {
+        return;
+    }
 
-            if (ax1 < bx2 && ax2 > bx1 && ay1 < by2 && ay2 > by1) {
-                overlaps = true;
-                break;
-            }
+    // Keep the pre-step positions only when a trail sample falls inside this step.
+    const double t0 = sim->time_seconds;
+    Arena* scratch = sim_worker_arena(sim, 0);
+    ArenaMark arena_start = arena_mark(scratch);
+    double* x0 = NULL;
+    double* y0 = NULL;
+    if (sim->trails.length > 0 && sim->trail_interval > 0.0 && sim->trail_next_sample <= t0 + dt_seconds) {
+        x0 = (double*)arena_alloc(scratch, count * sizeof(double));
+        y0 = (double*)arena_alloc(scratch, count * sizeof(double));
+        if (x0 && y0) {
+            memcpy(x0, sim->bodies.x.data, count * sizeof(double));
+            memcpy(y0, sim->bodies.y.data, count * sizeof(double));
         }
+    }
 
-        if (!overlaps) {
-            DrawText(candidates[i].name, candidates[i].x, candidates[i].y, label_font_size, LIGHTGRAY);
-        }
+    if (sim->integrator != SIM_INTEGRATOR_WISDOM_HOLMAN || !step_wisdom_holman(sim, dt_seconds)) {
+        step_verlet(sim, dt_seconds);
     }
 
-    sim->sim_arena->offset = arena_start;
-}
\ No newline at end of file
+    if (x0 && y0) {
+        record_trail_samples(sim, x0, y0, t0, dt_seconds);
+    }
+    arena_rewind(scratch, arena_start);
+
+    sim->time_seconds += dt_seconds;
+}
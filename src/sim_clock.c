@@ -0,0 +1,74 @@
+#include "sim_clock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+double sim_clock_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+void sim_clock_init(SimClock* clock, double fixed_dt, double budget_seconds) {
+    *clock = (SimClock){
+        .fixed_dt = fixed_dt,
+        .budget_seconds = budget_seconds,
+    };
+}
+
+double sim_clock_advance(SimClock* clock, SimContext* sim, double sim_dt) {
+    clock->steps_last_frame = 0;
+    clock->behind = false;
+    if (clock->fixed_dt <= 0.0 || sim_dt < 0.0) {
+        return 0.0;
+    }
+
+    clock->accumulator += sim_dt;
+
+    const double start = sim_clock_now();
+    double advanced = 0.0;
+    while (clock->accumulator >= clock->fixed_dt) {
+        // Only the frame's last step is drawn across. If the budget cuts the
+        // frame short instead, the clock is behind and draws the current state.
+        if (clock->accumulator < 2.0 * clock->fixed_dt) {
+            sim_keep_previous_positions(sim);
+        }
+        sim_step(sim, clock->fixed_dt);
+        clock->accumulator -= clock->fixed_dt;
+        advanced += clock->fixed_dt;
+        clock->steps_last_frame++;
+
+        if (sim_clock_now() - start >= clock->budget_seconds) {
+            break;
+        }
+    }
+
+    if (clock->accumulator >= clock->fixed_dt) {
+        clock->behind = true;
+        // Keep at most one frame of backlog; the rest is lost to real time.
+        double keep = sim_dt > clock->fixed_dt ? sim_dt : clock->fixed_dt;
+        if (clock->accumulator > keep) {
+            clock->dropped_seconds += clock->accumulator - keep;
+            clock->accumulator = keep;
+        }
+    }
+
+    return advanced;
+}
+
+double sim_clock_blend(const SimClock* clock) {
+    if (clock->fixed_dt <= 0.0 || clock->accumulator >= clock->fixed_dt) {
+        return 0.0;
+    }
+    return 1.0 - clock->accumulator / clock->fixed_dt;
+}
@@ -0,0 +1,140 @@
+#include "sim_draw.h"
+#include "rlgl.h"
+
+static Color to_color(SimColor c) {
+    return (Color){c.r, c.g, c.b, c.a};
+}
+
+int sim_draw_measure_text(const char* text, int font_size, void* user) {
+    (void)user;
+    return MeasureText(text, font_size);
+}
+
+void sim_draw_list(const SimRenderList* list) {
+    if (list->lines.length > 0) {
+        rlBegin(RL_LINES);
+        for (size_t i = 0; i < list->lines.length; i++) {
+            const SimVertex* v = &list->lines.data[i];
+            rlColor4ub(v->color.r, v->color.g, v->color.b, v->color.a);
+            rlVertex2f(v->x, v->y);
+        }
+        rlEnd();
+    }
+
+    // Quads go straight into one rlgl batch, textured with the shapes texel
+    // the way DrawRectangle does it, but without its per-call setup.
+    if (list->quads.length > 0) {
+        const Texture2D shapes = GetShapesTexture();
+        const Rectangle texel = GetShapesTextureRectangle();
+        const float u0 = texel.x / shapes.width, u1 = (texel.x + texel.width) / shapes.width;
+        const float v0 = texel.y / shapes.height, v1 = (texel.y + texel.height) / shapes.height;
+
+        rlSetTexture(shapes.id);
+        rlBegin(RL_QUADS);
+        for (size_t i = 0; i < list->quads.length; i++) {
+            const SimQuad* q = &list->quads.data[i];
+            const float x0 = (float)(int)q->x, y0 = (float)(int)q->y;
+            const float x1 = x0 + q->size, y1 = y0 + q->size;
+            rlColor4ub(q->color.r, q->color.g, q->color.b, q->color.a);
+            rlTexCoord2f(u0, v0);
+            rlVertex2f(x0, y0);
+            rlTexCoord2f(u0, v1);
+            rlVertex2f(x0, y1);
+            rlTexCoord2f(u1, v1);
+            rlVertex2f(x1, y1);
+            rlTexCoord2f(u1, v0);
+            rlVertex2f(x1, y0);
+        }
+        rlEnd();
+        rlSetTexture(0);
+    }
+
+    for (size_t i = 0; i < list->circles.length; i++) {
+        const SimCircle* c = &list->circles.data[i];
+        DrawCircle((int)c->x, (int)c->y, c->radius, to_color(c->color));
+    }
+
+    for (size_t i = 0; i < list->labels.length; i++) {
+        const SimLabel* l = &list->labels.data[i];
+        DrawText(l->text, l->x, l->y, l->font_size, to_color(l->color));
+    }
+}
+
+void sim_draw(const SimContext* sim, SimTextCache* text, double cam_x, double cam_y, double zoom, int screen_w,
+              int screen_h, double blend) {
+    const SimView view = {
+        .cam_x = cam_x,
+        .cam_y = cam_y,
+        .zoom = zoom,
+        .screen_w = screen_w,
+        .screen_h = screen_h,
+        .blend = blend,
+    };
+    Arena* scratch = sim_frame_arena(sim);
+    if (!scratch) {
+        return;
+    }
+    ArenaMark arena_start = arena_mark(scratch);
+
+    // A partial list from an exhausted arena is still worth drawing.
+    SimRenderList list;
+    sim_render_build(sim, &view, text, scratch, &list);
+    sim_draw_list(&list);
+
+    arena_rewind(scratch, arena_start);
+}
+
+void sim_draw_splat(const SimContext* sim, SimSplatTexture* target, double cam_x, double cam_y, double zoom,
+                    int screen_w, int screen_h, double blend) {
+    const SimView view = {
+        .cam_x = cam_x,
+        .cam_y = cam_y,
+        .zoom = zoom,
+        .screen_w = screen_w,
+        .screen_h = screen_h,
+        .blend = blend,
+    };
+    Arena* scratch = sim_frame_arena(sim);
+    if (!scratch) {
+        return;
+    }
+    ArenaMark arena_start = arena_mark(scratch);
+
+    SimSplat splat;
+    SimColor* pixels = NULL;
+    if (sim_splat_build(sim, &view, scratch, &splat) && splat.width > 0 && splat.height > 0) {
+        pixels = (SimColor*)arena_alloc(scratch, (size_t)splat.width * (size_t)splat.height * sizeof(SimColor));
+    }
+    if (pixels) {
+        sim_splat_tonemap(sim, &splat, pixels);
+
+        if (target->loaded && (target->texture.width != splat.width || target->texture.height != splat.height)) {
+            sim_splat_texture_unload(target);
+        }
+        if (!target->loaded) {
+            Image image = {
+                .data = pixels,
+                .width = splat.width,
+                .height = splat.height,
+                .mipmaps = 1,
+                .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+            };
+            target->texture = LoadTextureFromImage(image);
+            target->loaded = target->texture.id != 0;
+        } else {
+            UpdateTexture(target->texture, pixels);
+        }
+        if (target->loaded) {
+            DrawTexture(target->texture, 0, 0, WHITE);
+        }
+    }
+
+    arena_rewind(scratch, arena_start);
+}
+
+void sim_splat_texture_unload(SimSplatTexture* target) {
+    if (target->loaded) {
+        UnloadTexture(target->texture);
+    }
+    *target = (SimSplatTexture){0};
+}
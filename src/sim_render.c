@@ -0,0 +1,689 @@
+#include "sim_render.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRAIL_ALPHA_MIN 20.0f
+#define TRAIL_ALPHA_RANGE 180.0f
+// Lines are a pixel wide, so geometry this close outside the screen still shows.
+#define TRAIL_CULL_MARGIN 1.0
+#define BODY_MIN_RADIUS 2.0
+#define PARTICLE_SIZE 2.0f
+#define LABEL_FONT_SIZE 12
+#define LABEL_COLOR ((SimColor){200, 200, 200, 255})
+// Labels are binned into square cells of this many pixels, about one label
+// height, for overlap tests.
+#define LABEL_GRID_CELL 16
+#define TEXT_CACHE_MIN_CAPACITY 64
+// Points per splat binning task and rows per band, the unit of counting and
+// tone mapping.
+#define SPLAT_TASK_POINTS 16384
+#define SPLAT_TASK_ROWS 16
+// Counts below this are tone-mapped through a table instead of a log.
+#define SPLAT_TONE_TABLE 1024
+
+typedef struct {
+    const SimView* view;
+    double half_w, half_h;
+    SimColor color;
+    float alpha_step;
+    size_t remaining;  // trail points not visited yet
+    SimVertex last;    // pen position: the end of the last segment, or the last skipped point
+    bool has_last;
+    SimVertex* out;
+    size_t vertex_count;
+} TrailWriter;
+
+static bool outside_view(const SimView* view, double min_x, double min_y, double max_x, double max_y) {
+    return max_x < -TRAIL_CULL_MARGIN || max_y < -TRAIL_CULL_MARGIN || min_x > view->screen_w + TRAIL_CULL_MARGIN ||
+           min_y > view->screen_h + TRAIL_CULL_MARGIN;
+}
+
+// Visits ring indices [begin, begin + length), which must not wrap, chunk by
+// chunk. A chunk whose bounds, joined with the pen position, miss the screen
+// contributes nothing but its last point. Otherwise its anchor is moved to
+// screen space once, its float offsets are scaled onto it, points within a
+// pixel of the pen are merged into the next segment, and segments whose
+// bounds miss the screen are dropped.
+static void trail_span_vertices(TrailWriter* w, const TrailBuffer* trail, size_t begin, size_t length) {
+    const SimView* view = w->view;
+    const double zoom = view->zoom;
+
+    size_t k = 0;
+    while (k < length) {
+        const size_t index = begin + k;
+        const TrailChunk* chunk = &trail->chunks[index / SIM_TRAIL_CHUNK_POINTS];
+        const size_t lane = index % SIM_TRAIL_CHUNK_POINTS;
+        size_t lanes = SIM_TRAIL_CHUNK_POINTS - lane;
+        if (lanes > length - k) {
+            lanes = length - k;
+        }
+        k += lanes;
+
+        const double base_x = (chunk->anchor_x - view->cam_x) * zoom + w->half_w;
+        const double base_y = (chunk->anchor_y - view->cam_y) * zoom + w->half_h;
+        const float* dx = chunk->dx + lane;
+        const float* dy = chunk->dy + lane;
+        const float alpha0 = TRAIL_ALPHA_MIN + w->alpha_step * (float)(trail->count - w->remaining);
+
+        double min_x = base_x + chunk->min_dx * zoom, max_x = base_x + chunk->max_dx * zoom;
+        double min_y = base_y + chunk->min_dy * zoom, max_y = base_y + chunk->max_dy * zoom;
+        if (w->has_last) {
+            min_x = fmin(min_x, w->last.x);
+            max_x = fmax(max_x, w->last.x);
+            min_y = fmin(min_y, w->last.y);
+            max_y = fmax(max_y, w->last.y);
+        }
+        if (outside_view(view, min_x, min_y, max_x, max_y)) {
+            w->last = (SimVertex){(float)(base_x + dx[lanes - 1] * zoom), (float)(base_y + dy[lanes - 1] * zoom),
+                                  w->color};
+            w->last.color.a = (unsigned char)(alpha0 + w->alpha_step * (float)(lanes - 1));
+            w->has_last = true;
+            w->remaining -= lanes;
+            continue;
+        }
+
+        for (size_t l = 0; l < lanes; l++) {
+            SimVertex v = {(float)(base_x + dx[l] * zoom), (float)(base_y + dy[l] * zoom), w->color};
+            v.color.a = (unsigned char)(alpha0 + w->alpha_step * (float)l);
+            w->remaining--;
+            if (!w->has_last) {
+                w->last = v;
+                w->has_last = true;
+                continue;
+            }
+            if (w->remaining > 0 && fabsf(v.x - w->last.x) < 1.0f && fabsf(v.y - w->last.y) < 1.0f) {
+                continue;
+            }
+            if (!outside_view(view, fmin(v.x, w->last.x), fmin(v.y, w->last.y), fmax(v.x, w->last.x),
+                              fmax(v.y, w->last.y))) {
+                w->out[w->vertex_count++] = w->last;
+                w->out[w->vertex_count++] = v;
+            }
+            w->last = v;
+        }
+    }
+}
+
+size_t sim_trail_vertices(const TrailBuffer* trail, SimColor color, const SimView* view, SimVertex* out) {
+    const size_t count = trail->count;
+    if (count < 2 || trail->capacity == 0) {
+        return 0;
+    }
+
+    TrailWriter w = {
+        .view = view,
+        .half_w = view->screen_w * 0.5,
+        .half_h = view->screen_h * 0.5,
+        .color = color,
+        .alpha_step = TRAIL_ALPHA_RANGE / (float)count,
+        .remaining = count,
+        .out = out,
+    };
+
+    // Oldest first, the ring is [start, capacity) followed by [0, head).
+    const size_t start = (trail->head + trail->capacity - count) % trail->capacity;
+    const size_t first = count < trail->capacity - start ? count : trail->capacity - start;
+    trail_span_vertices(&w, trail, start, first);
+    trail_span_vertices(&w, trail, 0, count - first);
+    return w.vertex_count;
+}
+
+typedef struct {
+    const double *body_x, *body_y;
+    const double *particle_x, *particle_y;
+} DrawPositions;
+
+// The previous positions to blend from, or NULL to draw the current ones.
+static const PositionBuffer* blend_source(const SimContext* sim, const SimView* view) {
+    const PositionBuffer* previous = &sim->previous;
+    const bool usable = view->blend > 0.0 && previous->valid &&
+                        previous->x.length == sim_body_count(sim) + sim_particle_count(sim);
+    return usable ? previous : NULL;
+}
+
+// Where to draw each body and particle this frame. Blended positions are
+// written to `arena`; otherwise the stores are used as they are.
+static bool draw_positions(const SimContext* sim, const SimView* view, Arena* arena, DrawPositions* out) {
+    const size_t body_count = sim_body_count(sim);
+    const size_t total = body_count + sim_particle_count(sim);
+    const PositionBuffer* previous = blend_source(sim, view);
+    if (!previous || total == 0) {
+        *out = (DrawPositions){sim->bodies.x.data, sim->bodies.y.data, sim->particles.x.data, sim->particles.y.data};
+        return true;
+    }
+
+    double* x = (double*)arena_alloc_aligned(arena, total * sizeof(double), ARENA_SIMD_ALIGNMENT);
+    double* y = (double*)arena_alloc_aligned(arena, total * sizeof(double), ARENA_SIMD_ALIGNMENT);
+    if (!x || !y) {
+        return false;
+    }
+    const double t = view->blend;
+    for (size_t i = 0; i < body_count; i++) {
+        x[i] = sim->bodies.x.data[i] + (previous->x.data[i] - sim->bodies.x.data[i]) * t;
+        y[i] = sim->bodies.y.data[i] + (previous->y.data[i] - sim->bodies.y.data[i]) * t;
+    }
+    for (size_t i = body_count; i < total; i++) {
+        x[i] = sim->particles.x.data[i - body_count] + (previous->x.data[i] - sim->particles.x.data[i - body_count]) * t;
+        y[i] = sim->particles.y.data[i - body_count] + (previous->y.data[i] - sim->particles.y.data[i - body_count]) * t;
+    }
+    *out = (DrawPositions){x, y, x + body_count, y + body_count};
+    return true;
+}
+
+static bool build_trails(const SimContext* sim, const SimView* view, Arena* arena, SimRenderList* list) {
+    const size_t body_count = sim_body_count(sim);
+    const size_t count = sim->trails.length < body_count ? sim->trails.length : body_count;
+    const BodyMeta* meta = sim->bodies.meta.data;
+
+    for (size_t i = 0; i < count; i++) {
+        const TrailBuffer* trail = &sim->trails.data[i];
+        if (trail->count < 2) {
+            continue;
+        }
+        if (!array_grow_for(&list->lines, 2 * (trail->count - 1), arena)) {
+            return false;
+        }
+        list->lines.length += sim_trail_vertices(trail, meta[i].color, view, list->lines.data + list->lines.length);
+    }
+    return true;
+}
+
+// Culls in world space, so particles off screen cost two compares and no transform.
+static bool build_particles(const SimContext* sim, const SimView* view, const DrawPositions* pos, Arena* arena,
+                            SimRenderList* list) {
+    const double* px = pos->particle_x;
+    const double* py = pos->particle_y;
+    const SimColor* colors = sim->particles.color.data;
+    const double zoom = view->zoom;
+    const double half_w = view->screen_w * 0.5;
+    const double half_h = view->screen_h * 0.5;
+    const double min_x = view->cam_x - half_w / zoom, max_x = view->cam_x + half_w / zoom;
+    const double min_y = view->cam_y - half_h / zoom, max_y = view->cam_y + half_h / zoom;
+
+    const size_t count = sim_particle_count(sim);
+    for (size_t i = 0; i < count; i++) {
+        // One combined test: with short-circuit compares, which side a particle
+        // falls off is a coin flip for the branch predictor.
+        const bool inside = (px[i] >= min_x) & (px[i] < max_x) & (py[i] >= min_y) & (py[i] < max_y);
+        if (!inside) continue;
+        SimQuad quad = {(float)((px[i] - view->cam_x) * zoom + half_w), (float)((py[i] - view->cam_y) * zoom + half_h),
+                        PARTICLE_SIZE, colors[i]};
+        if (array_push(&list->quads, quad, arena) == ARRAY_NO_INDEX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool build_bodies(const SimContext* sim, const SimView* view, const DrawPositions* pos, Arena* arena,
+                         SimRenderList* list) {
+    const BodyStore* bodies = &sim->bodies;
+    const double half_w = view->screen_w * 0.5;
+    const double half_h = view->screen_h * 0.5;
+
+    const size_t count = sim_body_count(sim);
+    for (size_t i = 0; i < count; i++) {
+        double sx = (pos->body_x[i] - view->cam_x) * view->zoom + half_w;
+        double sy = (pos->body_y[i] - view->cam_y) * view->zoom + half_h;
+        double sr = (double)bodies->meta.data[i].radius * view->zoom;
+        if (sr < BODY_MIN_RADIUS) sr = BODY_MIN_RADIUS;
+        if (sx + sr < 0.0 || sy + sr < 0.0 || sx - sr > view->screen_w || sy - sr > view->screen_h) {
+            continue;
+        }
+
+        // Bodies drawn at the minimum size are a few pixels across; a square
+        // reads the same and skips tessellating a circle.
+        const SimColor color = bodies->meta.data[i].color;
+        size_t index;
+        if (sr == BODY_MIN_RADIUS) {
+            SimQuad quad = {(float)(sx - sr), (float)(sy - sr), (float)(2.0 * sr), color};
+            index = array_push(&list->quads, quad, arena);
+        } else {
+            SimCircle circle = {(float)sx, (float)sy, (float)sr, color};
+            index = array_push(&list->circles, circle, arena);
+        }
+        if (index == ARRAY_NO_INDEX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void sim_text_cache_init(SimTextCache* cache, SimTextMeasure measure, void* measure_user, Arena* arena) {
+    *cache = (SimTextCache){.measure = measure, .measure_user = measure_user, .arena = arena};
+}
+
+void sim_text_cache_clear(SimTextCache* cache) {
+    if (cache->entries) {
+        memset(cache->entries, 0, cache->capacity * sizeof(SimTextWidth));
+    }
+    cache->count = 0;
+}
+
+static size_t text_hash(const char* text, int font_size, size_t mask) {
+    uint64_t h = (uint64_t)(uintptr_t)text * 0x9E3779B97F4A7C15ull ^ (uint64_t)font_size;
+    return (size_t)(h ^ (h >> 29)) & mask;
+}
+
+static SimTextWidth* text_cache_slot(SimTextWidth* entries, size_t capacity, const char* text, int font_size) {
+    size_t i = text_hash(text, font_size, capacity - 1);
+    while (entries[i].text && (entries[i].text != text || entries[i].font_size != font_size)) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &entries[i];
+}
+
+// Keeps the load factor at or below one half.
+static bool text_cache_grow(SimTextCache* cache) {
+    const size_t capacity = cache->capacity ? cache->capacity * 2 : TEXT_CACHE_MIN_CAPACITY;
+    SimTextWidth* entries = (SimTextWidth*)arena_alloc(cache->arena, capacity * sizeof(SimTextWidth));
+    if (!entries) {
+        return false;
+    }
+    memset(entries, 0, capacity * sizeof(SimTextWidth));
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i].text) {
+            *text_cache_slot(entries, capacity, cache->entries[i].text, cache->entries[i].font_size) =
+                cache->entries[i];
+        }
+    }
+    arena_free(cache->arena, cache->entries, cache->capacity * sizeof(SimTextWidth));
+    cache->entries = entries;
+    cache->capacity = capacity;
+    return true;
+}
+
+int sim_text_width(SimTextCache* cache, const char* text, int font_size) {
+    if ((cache->count + 1) * 2 > cache->capacity && !text_cache_grow(cache)) {
+        return cache->measure(text, font_size, cache->measure_user);
+    }
+    SimTextWidth* slot = text_cache_slot(cache->entries, cache->capacity, text, font_size);
+    if (!slot->text) {
+        *slot = (SimTextWidth){text, font_size, cache->measure(text, font_size, cache->measure_user)};
+        cache->count++;
+    }
+    return slot->width;
+}
+
+typedef struct {
+    int x;
+    int y;
+    int w;
+    int h;
+    const char* name;
+} LabelCandidate;
+
+// Sorts 64-bit keys ascending, least significant byte first, skipping bytes
+// every key shares. Returns whichever of `keys` and `temp` holds the result.
+static uint64_t* radix_sort_u64(uint64_t* keys, uint64_t* temp, size_t count) {
+    size_t offsets[8][256] = {{0}};
+    for (size_t i = 0; i < count; i++) {
+        const uint64_t key = keys[i];
+        for (int d = 0; d < 8; d++) {
+            offsets[d][(key >> (8 * d)) & 0xFF]++;
+        }
+    }
+
+    for (int d = 0; d < 8; d++) {
+        const int shift = 8 * d;
+        if (offsets[d][(keys[0] >> shift) & 0xFF] == count) {
+            continue;
+        }
+        size_t total = 0;
+        for (int b = 0; b < 256; b++) {
+            const size_t n = offsets[d][b];
+            offsets[d][b] = total;
+            total += n;
+        }
+        for (size_t i = 0; i < count; i++) {
+            temp[offsets[d][(keys[i] >> shift) & 0xFF]++] = keys[i];
+        }
+        uint64_t* swap = keys;
+        keys = temp;
+        temp = swap;
+    }
+    return keys;
+}
+
+typedef struct {
+    int x, y, w, h;  // the placed label's rectangle
+    int next;        // next entry in the same cell, or -1
+} LabelCellEntry;
+
+DEFINE_ARRAY(LabelCellEntry);
+
+// Placed labels binned by screen cell; a label is listed in every cell it touches.
+typedef struct {
+    int cols, rows;
+    int* heads;  // first entry per cell, or -1
+    Array_LabelCellEntry entries;
+} LabelGrid;
+
+static void label_cells(const LabelGrid* grid, const LabelCandidate* c, int* x0, int* y0, int* x1, int* y1) {
+    *x0 = c->x < 0 ? 0 : c->x / LABEL_GRID_CELL;
+    *y0 = c->y < 0 ? 0 : c->y / LABEL_GRID_CELL;
+    *x1 = (c->x + c->w) / LABEL_GRID_CELL;
+    *y1 = (c->y + c->h) / LABEL_GRID_CELL;
+    if (*x1 >= grid->cols) *x1 = grid->cols - 1;
+    if (*y1 >= grid->rows) *y1 = grid->rows - 1;
+}
+
+static bool label_overlaps(const LabelGrid* grid, const LabelCandidate* c) {
+    int x0, y0, x1, y1;
+    label_cells(grid, c, &x0, &y0, &x1, &y1);
+    for (int cy = y0; cy <= y1; cy++) {
+        for (int cx = x0; cx <= x1; cx++) {
+            for (int e = grid->heads[cy * grid->cols + cx]; e >= 0; e = grid->entries.data[e].next) {
+                const LabelCellEntry* o = &grid->entries.data[e];
+                if (c->x < o->x + o->w && c->x + c->w > o->x && c->y < o->y + o->h && c->y + c->h > o->y) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+static bool label_insert(LabelGrid* grid, const LabelCandidate* c, Arena* arena) {
+    int x0, y0, x1, y1;
+    label_cells(grid, c, &x0, &y0, &x1, &y1);
+    for (int cy = y0; cy <= y1; cy++) {
+        for (int cx = x0; cx <= x1; cx++) {
+            int* head = &grid->heads[cy * grid->cols + cx];
+            size_t index = array_push(&grid->entries, ((LabelCellEntry){c->x, c->y, c->w, c->h, *head}), arena);
+            if (index == ARRAY_NO_INDEX) {
+                return false;
+            }
+            *head = (int)index;
+        }
+    }
+    return true;
+}
+
+// Labels on-screen named bodies, larger on screen first, skipping any label
+// that would overlap one already placed.
+static bool build_labels(const SimContext* sim, const SimView* view, const DrawPositions* pos, SimTextCache* text,
+                         Arena* arena, SimRenderList* list) {
+    const BodyStore* bodies = &sim->bodies;
+    const size_t body_count = sim_body_count(sim);
+    const double half_w = view->screen_w * 0.5;
+    const double half_h = view->screen_h * 0.5;
+    if (body_count == 0 || view->screen_w <= 0 || view->screen_h <= 0) {
+        return true;
+    }
+
+    LabelCandidate* candidates = (LabelCandidate*)arena_alloc(arena, body_count * sizeof(LabelCandidate));
+    // Sort keys: the on-screen radius as float bits, inverted so larger sorts
+    // first, above the candidate index, which keeps ties in body order.
+    uint64_t* keys = (uint64_t*)arena_alloc(arena, 2 * body_count * sizeof(uint64_t));
+    if (!candidates || !keys) {
+        return false;
+    }
+
+    size_t candidate_count = 0;
+    for (size_t i = 0; i < body_count; i += 1) {
+        const char* name = bodies->meta.data[i].name;
+        if (!name || !name[0]) {
+            continue;
+        }
+
+        double sx = (pos->body_x[i] - view->cam_x) * view->zoom + half_w;
+        double sy = (pos->body_y[i] - view->cam_y) * view->zoom + half_h;
+        double sr = (double)bodies->meta.data[i].radius * view->zoom;
+        if (sr < BODY_MIN_RADIUS) sr = BODY_MIN_RADIUS;
+
+        // Checked before measuring where possible: most bodies of a large system are off screen.
+        const int text_h = LABEL_FONT_SIZE;
+        const double tx = sx + sr + 4.0;
+        const double ty = sy - text_h / 2;
+        if (tx >= view->screen_w || ty >= view->screen_h || ty + text_h <= 0.0) {
+            continue;
+        }
+        const int text_w = sim_text_width(text, name, LABEL_FONT_SIZE);
+        if (tx + text_w <= 0.0) {
+            continue;
+        }
+
+        const float score = (float)sr;
+        uint32_t score_bits;
+        memcpy(&score_bits, &score, sizeof(score_bits));
+        keys[candidate_count] = (uint64_t)~score_bits << 32 | candidate_count;
+        candidates[candidate_count++] = (LabelCandidate){
+            .x = (int)tx,
+            .y = (int)ty,
+            .w = text_w,
+            .h = text_h,
+            .name = name,
+        };
+    }
+    if (candidate_count == 0) {
+        return true;
+    }
+
+    const uint64_t* sorted = radix_sort_u64(keys, keys + body_count, candidate_count);
+
+    LabelGrid grid = {
+        .cols = (view->screen_w + LABEL_GRID_CELL - 1) / LABEL_GRID_CELL,
+        .rows = (view->screen_h + LABEL_GRID_CELL - 1) / LABEL_GRID_CELL,
+    };
+    grid.heads = (int*)arena_alloc(arena, (size_t)grid.cols * (size_t)grid.rows * sizeof(int));
+    if (!grid.heads) {
+        return false;
+    }
+    memset(grid.heads, 0xFF, (size_t)grid.cols * (size_t)grid.rows * sizeof(int));
+    array_init(&grid.entries, 64, arena);
+
+    for (size_t i = 0; i < candidate_count; i++) {
+        const LabelCandidate* c = &candidates[sorted[i] & 0xFFFFFFFFu];
+        if (label_overlaps(&grid, c)) {
+            continue;
+        }
+        SimLabel label = {c->x, c->y, LABEL_FONT_SIZE, LABEL_COLOR, c->name};
+        if (array_push(&list->labels, label, arena) == ARRAY_NO_INDEX || !label_insert(&grid, c, arena)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sim_render_build(const SimContext* sim, const SimView* view, SimTextCache* text, Arena* arena,
+                      SimRenderList* list) {
+    *list = (SimRenderList){0};
+    DrawPositions pos;
+    return draw_positions(sim, view, arena, &pos) && build_trails(sim, view, arena, list) &&
+           build_particles(sim, view, &pos, arena, list) && build_bodies(sim, view, &pos, arena, list) &&
+           build_labels(sim, view, &pos, text, arena, list);
+}
+
+typedef struct {
+    const SimContext* sim;
+    const SimView* view;
+    const PositionBuffer* previous;  // blended from when not NULL
+    int width, height;
+    size_t bands;       // row bands of SPLAT_TASK_ROWS rows
+    size_t* slots;      // per point task and band: the count, then the next write position in binned
+    size_t* band_start;  // bands + 1 offsets into binned
+    uint32_t* binned;   // pixel indexes of the points on screen, grouped by band
+    SimSplat* splat;
+    uint32_t* band_max;
+} SplatJob;
+
+// Pixel index of point i (bodies, then particles), or -1 off screen.
+static int64_t splat_pixel(const SplatJob* job, size_t body_count, size_t i) {
+    const SimContext* sim = job->sim;
+    const SimView* view = job->view;
+    double x = i < body_count ? sim->bodies.x.data[i] : sim->particles.x.data[i - body_count];
+    double y = i < body_count ? sim->bodies.y.data[i] : sim->particles.y.data[i - body_count];
+    if (job->previous) {
+        x += (job->previous->x.data[i] - x) * view->blend;
+        y += (job->previous->y.data[i] - y) * view->blend;
+    }
+    const double sx = (x - view->cam_x) * view->zoom + view->screen_w * 0.5;
+    const double sy = (y - view->cam_y) * view->zoom + view->screen_h * 0.5;
+    const bool inside = (sx >= 0.0) & (sx < job->width) & (sy >= 0.0) & (sy < job->height);
+    return inside ? (int64_t)(int)sy * job->width + (int)sx : -1;
+}
+
+static void splat_task_range(const SplatJob* job, size_t task, size_t* begin, size_t* end) {
+    const size_t total = sim_body_count(job->sim) + sim_particle_count(job->sim);
+    *begin = task * SPLAT_TASK_POINTS;
+    *end = *begin + SPLAT_TASK_POINTS < total ? *begin + SPLAT_TASK_POINTS : total;
+}
+
+// Counts how many of the task's points land in each band.
+static void splat_bin_task(void* ctx, size_t task, int worker) {
+    (void)worker;
+    SplatJob* job = (SplatJob*)ctx;
+    const size_t body_count = sim_body_count(job->sim);
+    const size_t band_pixels = (size_t)SPLAT_TASK_ROWS * (size_t)job->width;
+    size_t* slots = job->slots + task * job->bands;
+    size_t begin, end;
+    splat_task_range(job, task, &begin, &end);
+
+    memset(slots, 0, job->bands * sizeof(size_t));
+    for (size_t i = begin; i < end; i++) {
+        const int64_t pixel = splat_pixel(job, body_count, i);
+        if (pixel < 0) continue;
+        slots[(size_t)pixel / band_pixels]++;
+    }
+}
+
+// Writes the task's pixel indexes into the positions the prefix sum gave it.
+static void splat_scatter_task(void* ctx, size_t task, int worker) {
+    (void)worker;
+    SplatJob* job = (SplatJob*)ctx;
+    const size_t body_count = sim_body_count(job->sim);
+    const size_t band_pixels = (size_t)SPLAT_TASK_ROWS * (size_t)job->width;
+    size_t* slots = job->slots + task * job->bands;
+    size_t begin, end;
+    splat_task_range(job, task, &begin, &end);
+
+    for (size_t i = begin; i < end; i++) {
+        const int64_t pixel = splat_pixel(job, body_count, i);
+        if (pixel < 0) continue;
+        job->binned[slots[(size_t)pixel / band_pixels]++] = (uint32_t)pixel;
+    }
+}
+
+// Counts one band's points into its own rows of splat->counts.
+static void splat_count_task(void* ctx, size_t band, int worker) {
+    (void)worker;
+    SplatJob* job = (SplatJob*)ctx;
+    const size_t row_begin = band * SPLAT_TASK_ROWS;
+    const size_t row_end = row_begin + SPLAT_TASK_ROWS < (size_t)job->height ? row_begin + SPLAT_TASK_ROWS
+                                                                             : (size_t)job->height;
+    uint32_t* counts = job->splat->counts;
+    memset(counts + row_begin * (size_t)job->width, 0, (row_end - row_begin) * (size_t)job->width * sizeof(uint32_t));
+
+    uint32_t band_max = 0;
+    for (size_t k = job->band_start[band]; k < job->band_start[band + 1]; k++) {
+        const uint32_t count = ++counts[job->binned[k]];
+        if (count > band_max) band_max = count;
+    }
+    job->band_max[band] = band_max;
+}
+
+bool sim_splat_build(const SimContext* sim, const SimView* view, Arena* arena, SimSplat* splat) {
+    const int width = view->screen_w > 0 ? view->screen_w : 0;
+    const int height = view->screen_h > 0 ? view->screen_h : 0;
+    const size_t cells = (size_t)width * (size_t)height;
+    const size_t bands = ((size_t)height + SPLAT_TASK_ROWS - 1) / SPLAT_TASK_ROWS;
+    const size_t total = sim_body_count(sim) + sim_particle_count(sim);
+    const size_t tasks = (total + SPLAT_TASK_POINTS - 1) / SPLAT_TASK_POINTS;
+
+    *splat = (SimSplat){.width = width, .height = height};
+    if (cells > UINT32_MAX) {
+        return false;
+    }
+    splat->counts = (uint32_t*)arena_alloc_aligned(arena, cells * sizeof(uint32_t), ARENA_SIMD_ALIGNMENT);
+    size_t* slots = (size_t*)arena_alloc(arena, (tasks * bands + 1) * sizeof(size_t));
+    size_t* band_start = (size_t*)arena_alloc(arena, (bands + 1) * sizeof(size_t));
+    uint32_t* band_max = (uint32_t*)arena_alloc(arena, (bands + 1) * sizeof(uint32_t));
+    if (!splat->counts || !slots || !band_start || !band_max) {
+        return false;
+    }
+    if (cells == 0) {
+        return true;
+    }
+
+    SplatJob job = {
+        .sim = sim,
+        .view = view,
+        .previous = blend_source(sim, view),
+        .width = width,
+        .height = height,
+        .bands = bands,
+        .slots = slots,
+        .band_start = band_start,
+        .splat = splat,
+        .band_max = band_max,
+    };
+    worker_pool_run(sim->pool, tasks, splat_bin_task, &job);
+
+    // Band-major prefix sum: each band's points end up together, in task order.
+    size_t offset = 0;
+    for (size_t b = 0; b < bands; b++) {
+        band_start[b] = offset;
+        for (size_t t = 0; t < tasks; t++) {
+            const size_t count = slots[t * bands + b];
+            slots[t * bands + b] = offset;
+            offset += count;
+        }
+    }
+    band_start[bands] = offset;
+
+    // Scratch is one index per point on screen, whatever the thread count.
+    job.binned = (uint32_t*)arena_alloc(arena, (offset + 1) * sizeof(uint32_t));
+    if (!job.binned) {
+        return false;
+    }
+    worker_pool_run(sim->pool, tasks, splat_scatter_task, &job);
+    worker_pool_run(sim->pool, bands, splat_count_task, &job);
+    for (size_t b = 0; b < bands; b++) {
+        if (band_max[b] > splat->max_count) splat->max_count = band_max[b];
+    }
+    return true;
+}
+
+typedef struct {
+    const SimSplat* splat;
+    const SimColor* table;  // tone for counts below SPLAT_TONE_TABLE
+    double scale;           // 1 / log(1 + max_count)
+    SimColor* pixels;
+} ToneJob;
+
+// Dark red through orange and yellow to white as t goes from 0 to 1.
+static SimColor splat_tone(double t) {
+    const double r = fmin(1.0, 0.25 + 1.5 * t);
+    const double g = fmin(1.0, fmax(0.0, 1.5 * t - 0.3));
+    const double b = fmin(1.0, fmax(0.0, 2.0 * t - 1.0));
+    return (SimColor){(unsigned char)(r * 255.0), (unsigned char)(g * 255.0), (unsigned char)(b * 255.0), 255};
+}
+
+static void splat_tone_task(void* ctx, size_t task, int worker) {
+    (void)worker;
+    ToneJob* job = (ToneJob*)ctx;
+    const SimSplat* splat = job->splat;
+    const size_t row_begin = task * SPLAT_TASK_ROWS;
+    const size_t row_end = row_begin + SPLAT_TASK_ROWS < (size_t)splat->height ? row_begin + SPLAT_TASK_ROWS
+                                                                                : (size_t)splat->height;
+    for (size_t i = row_begin * (size_t)splat->width; i < row_end * (size_t)splat->width; i++) {
+        const uint32_t count = splat->counts[i];
+        job->pixels[i] = count < SPLAT_TONE_TABLE ? job->table[count] : splat_tone(log1p((double)count) * job->scale);
+    }
+}
+
+void sim_splat_tonemap(const SimContext* sim, const SimSplat* splat, SimColor* pixels) {
+    SimColor table[SPLAT_TONE_TABLE];
+    const double scale = splat->max_count > 0 ? 1.0 / log1p((double)splat->max_count) : 0.0;
+    table[0] = (SimColor){0, 0, 0, 0};
+    for (uint32_t c = 1; c < SPLAT_TONE_TABLE; c++) {
+        table[c] = splat_tone(log1p((double)c) * scale);
+    }
+
+    ToneJob job = {.splat = splat, .table = table, .scale = scale, .pixels = pixels};
+    worker_pool_run(sim->pool, ((size_t)splat->height + SPLAT_TASK_ROWS - 1) / SPLAT_TASK_ROWS, splat_tone_task, &job);
+}
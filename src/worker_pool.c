@@ -0,0 +1,176 @@
+#include "worker_pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef struct {
+    WorkerPool* pool;
+    int index;
+} WorkerArgs;
+
+struct WorkerPool {
+    int thread_count;
+    pthread_t* threads;
+    WorkerArgs* args;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    unsigned long generation;  // bumped for every batch handed to the workers
+    int active_workers;
+    bool shutting_down;
+
+    WorkerTaskFn fn;
+    void* ctx;
+    size_t task_count;
+    size_t next_task;  // claimed with atomic fetch-add
+};
+
+static void worker_pool_drain(WorkerPool* pool, int worker_index) {
+    for (;;) {
+        size_t task = __atomic_fetch_add(&pool->next_task, 1, __ATOMIC_RELAXED);
+        if (task >= pool->task_count) {
+            return;
+        }
+        pool->fn(pool->ctx, task, worker_index);
+    }
+}
+
+static void* worker_main(void* arg) {
+    WorkerArgs* args = (WorkerArgs*)arg;
+    WorkerPool* pool = args->pool;
+    unsigned long seen_generation = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->shutting_down && pool->generation == seen_generation) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutting_down) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        worker_pool_drain(pool, args->index);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active_workers--;
+        if (pool->active_workers == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+WorkerPool* worker_pool_create(int thread_count) {
+    if (thread_count < 1) {
+        return NULL;
+    }
+
+    WorkerPool* pool = (WorkerPool*)calloc(1, sizeof(WorkerPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->thread_count = 1;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    const int extra = thread_count - 1;
+    if (extra > 0) {
+        pool->threads = (pthread_t*)calloc((size_t)extra, sizeof(pthread_t));
+        pool->args = (WorkerArgs*)calloc((size_t)extra, sizeof(WorkerArgs));
+        if (!pool->threads || !pool->args) {
+            worker_pool_destroy(pool);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < extra; i++) {
+        pool->args[i] = (WorkerArgs){pool, i + 1};
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->args[i]) != 0) {
+            // Keep the threads that did start; the pool just runs narrower.
+            break;
+        }
+        pool->thread_count = i + 2;
+    }
+
+    return pool;
+}
+
+void worker_pool_destroy(WorkerPool* pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count - 1; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->args);
+    free(pool->threads);
+    free(pool);
+}
+
+int worker_pool_thread_count(const WorkerPool* pool) {
+    return pool ? pool->thread_count : 1;
+}
+
+void worker_pool_run(WorkerPool* pool, size_t task_count, WorkerTaskFn fn, void* ctx) {
+    if (task_count == 0) {
+        return;
+    }
+
+    if (!pool || pool->thread_count == 1 || task_count == 1) {
+        for (size_t task = 0; task < task_count; task++) {
+            fn(ctx, task, 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->task_count = task_count;
+    pool->next_task = 0;
+    pool->active_workers = pool->thread_count - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    worker_pool_drain(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active_workers > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int worker_pool_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}